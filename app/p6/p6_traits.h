@@ -48,7 +48,7 @@ struct Traits<PEAMQ> : public Traits<Build>
 };
 
 template <>
-struct Traits<EAMQ> : public Traits<Build>
+struct Traits<EAMQ> : public Traits<Build>, public EAMQ_Defaults
 {
     static const bool debugged = false;
 };
@@ -36,7 +36,7 @@ struct Traits<Debug> : public Traits<Build>
 };
 
 template <>
-struct Traits<EAMQ> : public Traits<Build>
+struct Traits<EAMQ> : public Traits<Build>, public EAMQ_Defaults
 {
     static const bool debugged = false;
 };
@@ -34,6 +34,11 @@ template<> struct Traits<Debug>: public Traits<Build>
     static const bool trace   = false;
 };
 
+template<> struct Traits<EAMQ>: public Traits<Build>, public EAMQ_Defaults
+{
+    static const bool debugged = false;
+};
+
 template<> struct Traits<Lists>: public Traits<Build>
 {
     static const bool debugged = hysterically_debugged;
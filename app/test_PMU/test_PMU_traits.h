@@ -34,6 +34,13 @@ template<> struct Traits<Debug>: public Traits<Build>
     static const bool trace   = false;
 };
 
+template<> struct Traits<EAMQ>: public Traits<Build>, public EAMQ_Defaults
+{
+    static const bool debugged = false;
+
+    static const unsigned int profiler_period = 1000000; // unhalted cycles between two samples of the PMU sampling profiler
+};
+
 template<> struct Traits<Lists>: public Traits<Build>
 {
     static const bool debugged = hysterically_debugged;
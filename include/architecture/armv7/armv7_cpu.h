@@ -718,6 +718,8 @@ public:
     using CPU_Common::ntohl;
     using CPU_Common::ntohs;
 
+    using CPU_Common::cache_domain; // the cores of an MPCore share its L2
+
 private:
     template<typename Head, typename ... Tail>
     static void init_stack_helper(Log_Addr sp, Head head, Tail ... tail) {
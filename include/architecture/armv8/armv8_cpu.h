@@ -642,6 +642,9 @@ public:
     using CPU_Common::ntohl;
     using CPU_Common::ntohs;
 
+    // Cache topology: the cores of a cluster (MPIDR_EL1.Aff1) share the L2
+    static unsigned int cache_domain(unsigned int cpu) { return _cache_domain[cpu]; }
+
 private:
     template<typename Head, typename ... Tail>
     static void init_stack_helper(Log_Addr sp, Head head, Tail ... tail) {
@@ -657,6 +660,7 @@ private:
 private:
     static unsigned int _cpu_clock;
     static unsigned int _bus_clock;
+    static unsigned int _cache_domain[Traits<Build>::CPUS];
 };
 
 inline CPU::Reg64 htole64(CPU::Reg64 v) { return CPU::htole64(v); }
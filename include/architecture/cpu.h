@@ -103,6 +103,17 @@ public:
 
     static void halt() { for(;;); }
 
+    // Wait on a memory location (MONITOR/MWAIT on ia32); architectures without it report false and idle with halt()
+    static bool has_mwait() { return false; }
+    static void monitor(volatile void * addr) {}
+    static void mwait(unsigned int hint = 0) {}
+
+    // Timer interrupts at an absolute TSC value (TSC-deadline APIC timer on ia32)
+    static bool has_tsc_deadline() { return false; }
+
+    // Cache topology: cores with the same cache domain share the L2 (by default, all of them do)
+    static unsigned int cache_domain(unsigned int cpu) { return 0; }
+
     static void switch_context(Context * volatile * o, Context * volatile n);
 
 
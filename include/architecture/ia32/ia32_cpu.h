@@ -163,7 +163,8 @@ public:
         MSR_TSC                 = 0x0010,
         CLOCK_MODULATION        = 0x019a,
         THERM_STATUS            = 0x019c,
-        TEMPERATURE_TARGET      = 0x01a2
+        TEMPERATURE_TARGET      = 0x01a2,
+        TSC_DEADLINE            = 0x06e0
     };
 
     // GDT Entry
@@ -383,6 +384,18 @@ public:
 
     static void halt() { ASM("hlt"); }
 
+    // MONITOR/MWAIT (CPUID.01H:ECX[3]): mwait sleeps until the monitored cache line is written or an interrupt
+    // arrives (ECX[0] = 1 makes interrupts break it even with IF = 0, so the check before it can run with cli)
+    static bool has_mwait() { Reg32 a, b, c = 0, d; cpuid(1, &a, &b, &c, &d); return c & (1 << 3); }
+    static void monitor(volatile void * addr) { ASM("monitor" : : "a"(addr), "c"(0), "d"(0)); }
+    static void mwait(Reg32 hint = 0) { ASM("mwait" : : "a"(hint), "c"(1) : "memory"); }
+
+    // TSC-deadline mode of the local APIC timer (CPUID.01H:ECX[24])
+    static bool has_tsc_deadline() { Reg32 a, b, c = 0, d; cpuid(1, &a, &b, &c, &d); return c & (1 << 24); }
+
+    // Cache topology: cores with the same cache domain share the L2 (found by init() with CPUID leaves 4 and 0xB)
+    static unsigned int cache_domain(unsigned int cpu) { return _cache_domain[cpu]; }
+
     static void fpu_save() {} // TODO
     static void fpu_restore() {} // TODO
 
@@ -604,9 +617,11 @@ private:
 
     static void smp_barrier_init(unsigned int cores);
     static void init();
+    static unsigned int l2_domain();
 
 private:
     static volatile unsigned int _cores;
+    static unsigned int _cache_domain[Traits<Build>::CPUS];
     static Hertz _cpu_clock;
     static Hertz _cpu_current_clock;
     static Hertz _bus_clock;
@@ -705,16 +705,147 @@ public:
 
     static void clear_overflow(Channel channel) {
         assert(channel < CHANNELS);
-        wrmsr(GLOBAL_OVF, (PMC_MASK & 1ULL << (channel - FIXED))); //clear OVF flag
+        wrmsr(GLOBAL_OVF, (channel < FIXED) ? (1ULL << (CRT0_OVERFLOW + channel)) : (1ULL << (PMC0_OVERFLOW + channel - FIXED))); //clear OVF flag
+    }
+
+    // Sampling: the channel counts up from -events, so it overflows (and, with interrupt(), raises a PMI) after that many events
+    static void period(Channel channel, Count events) {
+        assert(channel < CHANNELS);
+        Count start = (0 - events) & COUNTER_MASK;
+        if(channel < FIXED)
+            wrmsr(FIXED_CTR0 + channel, start);
+        else
+            wrmsr(PMC_BASE_ADDR + channel - FIXED, start); // only bits 31:0, sign-extended
+    }
+
+    static void interrupt(Channel channel, bool enable) {
+        assert(channel < CHANNELS);
+        db<PMU>(TRC) << "PMU::interrupt(c=" << channel << ",e=" << enable << ")" << endl;
+        if(channel < FIXED) {
+            Reg64 pmi = 1ULL << (CRT0_ENABLE_INT + channel * 4);
+            wrmsr(FIXED_CTR_CTL, enable ? (rdmsr(FIXED_CTR_CTL) | pmi) : (rdmsr(FIXED_CTR_CTL) & ~pmi));
+        } else {
+            Reg32 evtsel = EVTSEL0 + channel - FIXED;
+            wrmsr(evtsel, enable ? (rdmsr(evtsel) | Intel_PMU_V1::INT) : (rdmsr(evtsel) & ~Reg64(Intel_PMU_V1::INT)));
+        }
     }
 
     static void handler(Handler * handler, Channel channel) {
-        if((channel - FIXED) < CHANNELS)
-            _handlers[channel - FIXED] = handler;
+        if(channel < CHANNELS)
+            _handlers[channel] = handler;
         else
             db<Init, Intel_PMU_V1>(WRN) << "Intel_PMU_V1::handler = Bad PMC value, handler not addressed!" << endl;
     }
 
+    // Per-thread virtual counters: the instructions of fixed channel 2 and an event set on the general-purpose
+    // channels (0 and 1 keep counting for the CPU, for DVFS_Governor and Profiler). save() freezes them with a single
+    // GLOBAL_CTRL write and load() thaws them with another; counts are the rdpmc deltas in between, so no counter is
+    // ever written. Event sets larger than the general-purpose channels are split in groups that take turns, one per
+    // residency, and each group's counts are scaled by the number of groups
+    class Context
+    {
+    public:
+        static const unsigned int MAX_EVENTS = 16;
+
+    private:
+        static const unsigned int GENERAL = CHANNELS - FIXED;
+        static const unsigned int INSTRUCTIONS = MAX_EVENTS; // index of fixed channel 2 in _count and _last
+        static const unsigned int NONE = MAX_EVENTS + 1;
+
+    public:
+        Context() { events(_defaults, GENERAL); }
+
+        // Events are indices in _events[], as for config(); the new set is counted from the next load()
+        void events(const Event * events, unsigned int n) {
+            _n = (n > MAX_EVENTS) ? MAX_EVENTS : n;
+            for(unsigned int i = 0; i < _n; i++) {
+                assert((events[i] < EVENTS) && _events[events[i]] != UNSUPORTED_EVENT);
+                _event[i] = events[i];
+            }
+            for(unsigned int i = 0; i <= MAX_EVENTS; i++)
+                _count[i] = _last[i] = 0;
+            _group = 0;
+            _loaded = false;
+        }
+
+        Count read(Event event) const { unsigned int i = index(event); return (i != NONE) ? _count[i] : 0; }
+        Count last(Event event) const { unsigned int i = index(event); return (i != NONE) ? _last[i] : 0; }
+
+        void save() {
+            unsigned int cpu = CPU::id();
+            Reg64 ctrl = rdmsr(GLOBAL_CTRL);
+            wrmsr(GLOBAL_CTRL, ctrl & ~VIRTUAL);
+            _global[cpu] = ctrl;
+
+            Count now = Intel_Sandy_Bridge_PMU::read(FIXED - 1);
+            _last[INSTRUCTIONS] = (now - _base[cpu][GENERAL]) & COUNTER_MASK;
+            _count[INSTRUCTIONS] += _last[INSTRUCTIONS];
+            _base[cpu][GENERAL] = now;
+
+            for(unsigned int i = 0; i < _n; i++)
+                _last[i] = 0;
+            unsigned int first = _group * GENERAL;
+            for(unsigned int c = 0; c < GENERAL; c++) {
+                now = Intel_Sandy_Bridge_PMU::read(FIXED + c);
+                if(_loaded && (first + c < _n)) {
+                    _last[first + c] = ((now - _base[cpu][c]) & COUNTER_MASK) * groups();
+                    _count[first + c] += _last[first + c];
+                }
+                _base[cpu][c] = now;
+            }
+            if(_loaded)
+                _group = (_group + 1) % groups();
+            _loaded = false;
+        }
+
+        void load() {
+            unsigned int cpu = CPU::id();
+            unsigned int first = _group * GENERAL;
+            for(unsigned int c = 0; c < GENERAL; c++) {
+                Reg64 evtsel = (first + c < _n) ? (_events[_event[first + c]] | USR | OS | ENABLE) : 0;
+                if(_evtsel[cpu][c] != evtsel) {
+                    wrmsr(EVTSEL0 + c, evtsel);
+                    _evtsel[cpu][c] = evtsel;
+                }
+            }
+            _loaded = true;
+
+            wrmsr(GLOBAL_CTRL, _global[cpu] | VIRTUAL);
+        }
+
+    private:
+        unsigned int groups() const { return _n ? (_n + GENERAL - 1) / GENERAL : 1; }
+
+        unsigned int index(Event event) const {
+            if(event == PMU_Event::INSTRUCTIONS_RETIRED)
+                return INSTRUCTIONS;
+            for(unsigned int i = 0; i < _n; i++)
+                if(_event[i] == event)
+                    return i;
+            return NONE;
+        }
+
+    private:
+        Event _event[MAX_EVENTS];
+        unsigned int _n;
+        unsigned int _group;    // the one counting while loaded
+        bool _loaded;           // false => the general-purpose channels are not counting this context's events
+        Count _count[MAX_EVENTS + 1];
+        Count _last[MAX_EVENTS + 1];
+    };
+
+protected:
+    static const Count COUNTER_MASK = (1ULL << 48) - 1; // counter width
+    static const Reg64 VIRTUAL = (1ULL << CRT2_ENABLE) | ((1ULL << (CHANNELS - FIXED)) - 1); // GLOBAL_CTRL bits of the channels in Context
+
+    static Handler * _handlers[CHANNELS]; // per channel (fixed ones first), called on overflow by PMU::int_handler()
+
+    // Context: per CPU
+    static const Event _defaults[CHANNELS - FIXED];
+    static Reg64 _global[Traits<Build>::CPUS];
+    static Count _base[Traits<Build>::CPUS][CHANNELS - FIXED + 1]; // last rdpmc of each channel (fixed channel 2 last)
+    static Reg64 _evtsel[Traits<Build>::CPUS][CHANNELS - FIXED]; // as last written (reset() leaves them 0)
+
 private:
     static const Event _events[EVENTS];
 };
@@ -742,6 +873,10 @@ public:
 public:
     PMU() {}
 
+    // PMIs on this CPU (the APIC LVT_PERF entry); each channel also needs interrupt() and a handler()
+    static void int_enable();
+    static void int_disable();
+
 private:
     static void int_handler(Interrupt_Id i);
 
@@ -13,6 +13,15 @@ template<> struct Traits<CPU>: public Traits<Build>
     static const unsigned int WORD_SIZE         = 32;
     static const unsigned int CLOCK             = 2000000000;
     static const bool unaligned_memory_access   = true;
+
+    // Power model (in mW) used by Energy_Meter: POWER[i] is the active power with the clock modulated to
+    // i x 6.25% of CLOCK (POWER[16] => full speed) and POWER_HALT the power while halted (hlt)
+    static const unsigned int POWER_STEPS       = 17;
+    static constexpr unsigned int POWER[POWER_STEPS] = { 1200,  2060,  2930,  3790,  4650,  5510,  6380,  7240,
+                                                         8100,  8960,  9830, 10690, 11550, 12410, 13280, 14140, 15000};
+    static const unsigned int POWER_HALT        = 1200;
+    static const unsigned int HALT_LATENCY      = 2;    // us to leave hlt (C1)
+    static const unsigned int SLOW_IDLE         = 1000; // us of predicted idle from which the clock is also lowered
 };
 
 template<> struct Traits<TSC>: public Traits<Build>
@@ -4,6 +4,7 @@
 #define __pmu_h
 
 #include <system/config.h>
+#include <utility/handler.h>
 
 __BEGIN_SYS
 
@@ -35,6 +36,29 @@ public:
     static void start(Channel channel) {}
     static void stop(Channel channel) {}
     static void reset(Channel channel) {}
+
+    // Overflow interrupts (sampling), where supported
+    static void period(Channel channel, Count events) {}
+    static void interrupt(Channel channel, bool enable) {}
+    static void handler(Handler * handler, Channel channel) {}
+    static void int_enable() {}
+    static void int_disable() {}
+
+    // Per-thread virtual counters: Thread::dispatch() saves the context of the thread leaving the CPU and loads
+    // the one of the thread entering it. Where the PMU can't be virtualized, they count nothing
+    class Context
+    {
+    public:
+        Context() {}
+
+        void events(const Event * events, unsigned int n) {}
+
+        Count read(Event event) const { return 0; } // since events()
+        Count last(Event event) const { return 0; } // during the last residency
+
+        void save() {}
+        void load() {}
+    };
 };
 
 #ifndef __PMU_H
@@ -0,0 +1,52 @@
+// EPOS PMU-based Sampling Profiler Declarations
+
+#ifndef __profiler_h
+#define __profiler_h
+
+#include <architecture/cpu.h>
+#include <architecture/pmu.h>
+
+__BEGIN_SYS
+
+// Sampling Profiler
+// PMU channel 1 (unhalted core cycles, which nothing else uses) raises a PMI every Traits<EAMQ>::profiler_period
+// cycles. Each PMI records the interrupted IP and the running thread in a ring buffer of its core, so hot spots
+// can be found without reading counters at every context switch. When a ring is full, new samples are dropped
+// (and counted in lost()) until dump() drains it.
+class Profiler
+{
+public:
+    static const bool enabled = Traits<PMU>::enabled && (Traits<EAMQ>::profiler_period > 0);
+    static const unsigned int CHANNEL = 1;
+    static const unsigned int SAMPLES = Traits<EAMQ>::profiler_samples; // per core
+
+    struct Sample
+    {
+        CPU::Log_Addr ip;
+        Thread * thread;
+    };
+
+public:
+    static void init();
+
+    // On the calling CPU
+    static void start();
+    static void stop();
+
+    // Moves up to n of the oldest samples of cpu into samples and returns how many; one caller per cpu at a time
+    static unsigned int dump(unsigned int cpu, Sample * samples, unsigned int n);
+    static unsigned long lost(unsigned int cpu) { return _lost[cpu]; }
+
+private:
+    static void sample();
+
+private:
+    static Sample _ring[Traits<Machine>::CPUS][SAMPLES];
+    static volatile unsigned long _head[Traits<Machine>::CPUS]; // written only by the PMI of the core
+    static volatile unsigned long _tail[Traits<Machine>::CPUS]; // written only by dump()
+    static volatile unsigned long _lost[Traits<Machine>::CPUS];
+};
+
+__END_SYS
+
+#endif
@@ -321,6 +321,8 @@ public:
     using CPU_Common::ntohl;
     using CPU_Common::ntohs;
 
+    using CPU_Common::cache_domain;
+
     template<typename ... Tn>
     static Context * init_stack(Log_Addr usp, Log_Addr sp, void (* exit)(), int (* entry)(Tn ...), Tn ... an) {
         sp -= sizeof(Context);
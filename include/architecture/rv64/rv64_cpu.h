@@ -235,6 +235,9 @@ public:
     static unsigned int id() { return tp(); }
     static unsigned int cores() { return Traits<Build>::CPUS; }
 
+    // Cache topology (static): on SiFive_U, all the harts share the L2
+    static unsigned int cache_domain(unsigned int cpu) { return 0; }
+
     static void smp_barrier(unsigned long cores = CPU::cores()) { CPU_Common::smp_barrier<&finc>(cores, id()); }
 
     using CPU_Common::clock;
@@ -0,0 +1,102 @@
+// EPOS DVFS Governor Declarations
+
+#ifndef __dvfs_h
+#define __dvfs_h
+
+#include <architecture/cpu.h>
+#include <architecture/pmu.h>
+
+__BEGIN_SYS
+
+// EAMQ Frequency Ladders
+// Each ladder gives the number of EAMQ sub-queues (STEPS) and the share of CPU::max_clock() each one runs at,
+// in 1/10000 (the resolution of the ia32 clock modulation in CPU::clock()). Sub-queue 0 is always the fastest.
+// Selected by Traits<EAMQ>::Ladder.
+
+// Evenly spaced: 10000 - STEP * q
+template<unsigned int Q, unsigned int STEP>
+class Linear_Ladder
+{
+public:
+    static const unsigned int STEPS = Q;
+
+    static_assert((Q > 0) && (STEP * (Q - 1) < 10000), "Linear_Ladder would reach 0 Hz");
+
+public:
+    static constexpr unsigned int share(unsigned int q) { return 10000 - STEP * q; }
+};
+
+// The duty-cycle steps of the ia32 clock modulation MSR (6.25%, down to its 18.75% minimum)
+template<unsigned int Q>
+class Clock_Modulation_Ladder: public Linear_Ladder<Q, 625>
+{
+    static_assert(625 * (Q - 1) <= 10000 - 1875, "Clock modulation cannot go below 18.75%");
+};
+
+// A machine-provided table of operating points (e.g. P-states), fastest first
+template<unsigned int ... P>
+class Table_Ladder
+{
+public:
+    static const unsigned int STEPS = sizeof...(P);
+
+    static_assert(STEPS > 0, "Table_Ladder needs at least one operating point");
+
+public:
+    static constexpr unsigned int share(unsigned int q) { return _share[q]; }
+
+private:
+    static constexpr unsigned int _share[] = {P ...};
+};
+
+template<unsigned int ... P>
+constexpr unsigned int Table_Ladder<P ...>::_share[];
+
+// DVFS Governor
+// Sits between EAMQ and CPU::clock(), keeping one operating point per core (in 1/10000 of CPU::max_clock()).
+// The clock is only written when the operating point really changes: speed-ups are applied at once (deadlines),
+// while slow-downs must be requested HYSTERESIS consecutive times, so a core that bounces between sub-queues
+// does not rewrite IA32_CLOCK_MODULATION at every dispatch.
+class DVFS_Governor
+{
+public:
+    typedef PMU_Common::Count Count;
+
+    static const bool enabled = Traits<EAMQ>::dvfs && !Traits<System>::RUN_TO_HALT;
+    static const unsigned int HYSTERESIS = Traits<EAMQ>::dvfs_hysteresis;
+    static const unsigned int FULL = 10000;
+
+public:
+    static void init();
+
+    static void request(unsigned int share);
+    static unsigned int share() { return _applied[CPU::id()]; }
+
+    // Idle_Manager: clock at the minimum while the core sleeps, then back to the previous operating point
+    static unsigned int park() { unsigned int s = share(); if(enabled && (s != PARKED)) apply(PARKED); return s; }
+    static void unpark(unsigned int s) { if(enabled && (s != share())) apply(s); }
+
+    // Ciclos de referencia (canal 0 da PMU) desde o ultimo restart(), em ciclos a frequencia maxima.
+    // O contador so anda enquanto o clock modulado esta ativo, entao cada trecho entre duas transicoes
+    // e escalado pelo inverso do operating point em que foi medido
+    static Count cycles();
+    static void restart();
+
+private:
+    static const unsigned int SHIFT = 16;
+    static const unsigned int PARKED = 1875; // CPU::clock() does not modulate below 18.75%
+
+    static Count scale(Count c, unsigned int share) { return (c * ((FULL << SHIFT) / share)) >> SHIFT; }
+    static void apply(unsigned int share);
+
+private:
+    static unsigned int _applied[Traits<Machine>::CPUS];
+    static unsigned int _pending[Traits<Machine>::CPUS];  // operating point mais rapido pedido desde a ultima transicao
+    static unsigned int _streak[Traits<Machine>::CPUS];   // pedidos consecutivos por um operating point mais lento
+    static Count _base[Traits<Machine>::CPUS];            // PMU::read(0) na ultima transicao
+    static Count _carry[Traits<Machine>::CPUS];           // ciclos ja escalados antes da ultima transicao
+};
+
+__END_SYS
+
+#endif
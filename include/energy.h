@@ -0,0 +1,52 @@
+// EPOS Energy Meter Declarations
+
+#ifndef __energy_h
+#define __energy_h
+
+#include <architecture/cpu.h>
+#include <architecture/tsc.h>
+
+__BEGIN_SYS
+
+// Energy Meter
+// Model-based energy estimate (so it also works under QEMU): each core integrates, over the TSC, the power
+// given by Traits<CPU> for its current state (halted or active at the DVFS_Governor operating point).
+// Energy is kept in mW x TSC cycles, so accounting is a multiplication; microjoules() converts it when reported.
+class Energy_Meter
+{
+public:
+    typedef unsigned long long Energy;
+
+    static const bool enabled = Traits<EAMQ>::energy;
+
+public:
+    static void init();
+
+    // Closes the current interval; claim() also hands over what was spent since the last claim (to the running thread)
+    static void account();
+    static Energy claim();
+
+    // Thread::idle() around CPU::halt()
+    static void halt() { account(); _halted[CPU::id()] = true; }
+    static void wake() { account(); _halted[CPU::id()] = false; }
+
+    static Energy total(unsigned int cpu) { return _total[cpu]; }
+
+    // Power (mW) with the clock at share (in 1/10000 of CPU::max_clock()) and while halted
+    static unsigned int power(unsigned int share) { return Traits<CPU>::POWER[share * (Traits<CPU>::POWER_STEPS - 1) / 10000]; }
+    static unsigned int halt_power() { return Traits<CPU>::POWER_HALT; }
+    static unsigned long long microjoules(Energy e) { return e / (CPU::max_clock() / 1000); } // mW x s = 1000 uJ
+
+private:
+    static unsigned int power();
+
+private:
+    static TSC::Time_Stamp _stamp[Traits<Machine>::CPUS];
+    static bool _halted[Traits<Machine>::CPUS];
+    static Energy _total[Traits<Machine>::CPUS];
+    static Energy _unclaimed[Traits<Machine>::CPUS];
+};
+
+__END_SYS
+
+#endif
@@ -0,0 +1,38 @@
+// EPOS Idle State Manager Declarations
+
+#ifndef __idle_h
+#define __idle_h
+
+#include <architecture/cpu.h>
+
+__BEGIN_SYS
+
+// Idle State Manager
+// Picks how an idle core sleeps, given how long it is expected to stay idle:
+//   HALT:  hlt (the only option without MWAIT);
+//   MWAIT: mwait on the core's wakeup flag, so remote wakeups only need to write it (no IPI);
+//   SLOW:  the above with the clock parked at its minimum by DVFS_Governor, for long idle periods.
+class Idle_Manager
+{
+public:
+    enum State { HALT, MWAIT, SLOW };
+
+public:
+    static void init();
+
+    static State choose(Microsecond predicted);
+
+    // Sleeps until an interrupt or (with MWAIT) a write to wakeup; returns at once if wakeup is already set
+    static void sleep(Microsecond predicted, volatile bool & wakeup);
+
+    // cpu is waiting on its wakeup flag: writing it is enough to wake it up
+    static bool listening(unsigned int cpu) { return _listening[cpu]; }
+
+private:
+    static bool _mwait;
+    static volatile unsigned int _listening[Traits<Machine>::CPUS];
+};
+
+__END_SYS
+
+#endif
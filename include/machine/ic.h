@@ -66,6 +66,7 @@ public:
     static Interrupt_Id int2irq(Interrupt_Id i);       // Offset INTs as seen by the CPU to IRQs seen by the bus (if needed)
 
     static void ipi(unsigned int cpu, Interrupt_Id i); // Inter-processor Interrupt
+    static void ipi_multicast(unsigned long cpus, Interrupt_Id i); // Inter-processor Interrupt to all CPUs in a bitmap
 };
 
 __END_SYS
@@ -65,6 +65,14 @@ template<> struct Traits<Timer>: public Traits<Machine_Common>
     // 10000 Hz. The choice must respect the scheduler time-slice, i. e.,
     // it must be higher than the scheduler invocation frequency.
     static const int FREQUENCY = 1000; // Hz
+
+    // Dynamic ticks: while a core is idle or has a single runnable thread, the APIC timer is programmed in
+    // one-shot mode up to the next event and the skipped ticks are caught up from the TSC (multicore only)
+    static const bool tickless = true;
+
+    // High-resolution alarms: besides the ticks, the APIC timer interrupts at the exact TSC expiration of the
+    // next alarm (TSC-deadline mode when available, one-shot otherwise), so periods need not be whole ticks (multicore only)
+    static const bool high_resolution = true;
 };
 
 template<> struct Traits<RTC>: public Traits<Machine_Common>
@@ -142,6 +142,7 @@ public:
     }
 
     static void ipi(int dest, int interrupt) {}
+    static void ipi_multicast(unsigned long dests, int interrupt) {}
 };
 
 // Intel IA-32 APIC (internal, not tested with 82489DX)
@@ -298,6 +299,7 @@ public:
         // Local Timer (32 bits)
         TIMER_PERIODIC          = (1 << 17),
         TIMER_ONE_SHOT          = (0 << 17),
+        TIMER_TSC_DEADLINE      = (2 << 17),
         TIMER_MASKED            = LVT_MASKED,
         TIMER_PRESCALE_BY_1     = 0xb,
         TIMER_PRESCALE_BY_2     = 0x0,
@@ -348,6 +350,7 @@ public:
     }
 
     static void ipi(unsigned int cpu, unsigned int interrupt);
+    static void ipi_multicast(unsigned long cpus, unsigned int interrupt);
     static void ipi_init(volatile int * status);
     static void ipi_start(Log_Addr entry, volatile int * status);
 
@@ -358,6 +361,9 @@ public:
         remap(addr);
         if(Traits<System>::multicore) {
             clear();
+            // Flat logical destinations (bit n => CPU n) for multicast IPIs
+            write(DFR, 0xffffffff);
+            write(LDR, (1 << id()) << 24);
             enable();
             connect();
         } else
@@ -373,12 +379,20 @@ public:
         Reg v = INT_TIMER;
         v |= (interrupt) ? 0 : TIMER_MASKED;
         v |= (periodic) ? TIMER_PERIODIC : 0;
+        write(LVT_TIMER, v | TIMER_MASKED); // the initial count is ignored while in TSC-deadline mode
         write(TIMER_INITIAL, count / 16);
         write(TIMER_PRESCALE, TIMER_PRESCALE_BY_16);
         reset_timer();
         write(LVT_TIMER, v);
     }
 
+    // Interrupt when the TSC reaches deadline (writing 0 disarms it)
+    static void config_timer_deadline(CPU::Reg64 deadline) {
+        write(LVT_TIMER, INT_TIMER | TIMER_TSC_DEADLINE);
+        ASM("mfence" : : : "memory"); // the mode switch must be visible before the MSR write (SDM 10.5.4.1)
+        CPU::wrmsr(CPU::TSC_DEADLINE, deadline);
+    }
+
     static void enable_timer() {
         write(LVT_TIMER, read(LVT_TIMER) & ~TIMER_MASKED);
     }
@@ -529,16 +543,22 @@ public:
     }
 
     using Engine::ipi;
+    using Engine::ipi_multicast;
     using Engine::irq2int;
 
+    // IP the PMU interrupt (INT_PMU) being handled on this CPU interrupted (see pmu_entry()); only valid within its handler
+    static Log_Addr interrupted_ip() { return _interrupted[CPU::id()]->_eip; }
+
 private:
     static void dispatch(unsigned int i) __attribute__ ((thiscall));
+    static void pmu_dispatch(CPU::Context * context);
 
     // Logical handlers
     static void int_not(Interrupt_Id i);
 
     // Physical handlers
     static void entry() __attribute__ ((naked));
+    static void pmu_entry() __attribute__ ((naked));
     static void exc_not(Reg eip, Reg cs, Reg eflags, Reg error) __attribute__ ((naked));
     static void exc_pf (Reg eip, Reg cs, Reg eflags, Reg error) __attribute__ ((naked));
     static void exc_gpf(Reg eip, Reg cs, Reg eflags, Reg error) __attribute__ ((naked));
@@ -548,6 +568,7 @@ private:
 
 private:
     static Interrupt_Handler _int_vector[INTS];
+    static CPU::Context * volatile _interrupted[Traits<Machine>::CPUS];
 };
 
 // Core id in IA32 is handled by the APIC
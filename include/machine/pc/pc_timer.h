@@ -7,6 +7,7 @@
 #include <machine/ic.h>
 #include <machine/rtc.h>
 #include <machine/timer.h>
+#include <architecture/tsc.h>
 
 __BEGIN_SYS
 
@@ -277,7 +278,7 @@ public:
         return percentage;
     }
 
-    static void reset() { db<Timer>(TRC) << "Timer::reset()" << endl; Engine::config(0, Engine::clock() / FREQUENCY); }
+    static void reset() { db<Timer>(TRC) << "Timer::reset()" << endl; Engine::config(0, Engine::clock() / FREQUENCY); _one_shot[CPU::id()] = false; _deadline[CPU::id()] = 0; _stamp[CPU::id()] = TSC::time_stamp(); }
     static void enable() { db<Timer>(TRC) << "Timer::enable()" << endl; IC::enable(IC::INT_SYS_TIMER); }
     static void disable() { db<Timer>(TRC) << "Timer::disable()" << endl; IC::disable(IC::INT_SYS_TIMER); }
 
@@ -287,7 +288,29 @@ public:
 
     void handler(Handler handler) { _handler = handler; }
 
+    // Tickless operation (only with the APIC timer, which has a one-shot mode)
+    static const bool tickless = Traits<Timer>::tickless && multicore;
+
+    // Next interrupt on this core in up to limit ticks (and at the end of the time slice, if slice), or at
+    // the next tick if that is sooner anyway; the ticks in between are accounted by int_handler() from the TSC
+    static void one_shot(Tick limit, bool slice);
+    // Back to one interrupt per tick
+    static void periodic();
+
+    // High-resolution operation (also only with the APIC timer)
+    static const bool high_resolution = Traits<Timer>::high_resolution && multicore;
+
+    // An extra interrupt on this core when the TSC reaches at (0 cancels), which calls the handler set by precise()
+    static void deadline(TSC::Time_Stamp at);
+    static void precise(Handler handler) { _precise = handler; }
+
 private:
+    // TSC cycles per tick (the TSC does not follow CPU::clock())
+    static TSC::Time_Stamp cycles() { return CPU::max_clock() / FREQUENCY; }
+
+    static Tick elapsed();
+    // One-shot interrupt at TSC time at
+    static void arm(TSC::Time_Stamp at);
     static void int_handler(Interrupt_Id i);
 
     static void init();
@@ -300,6 +323,11 @@ protected:
     Handler _handler;
 
     static Timer * _channels[CHANNELS];
+    static bool _one_shot[Traits<Machine>::CPUS];
+    static TSC::Time_Stamp _stamp[Traits<Machine>::CPUS]; // TSC of the last accounted tick
+    static TSC::Time_Stamp _deadline[Traits<Machine>::CPUS];
+    static Handler _precise;
+    static bool _tsc_deadline;
 };
 
 
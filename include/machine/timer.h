@@ -24,6 +24,8 @@ public:
     typedef long Tick;
     typedef IC_Common::Interrupt_Handler Handler;
 
+    static const Tick FOREVER = ~0UL >> 1; // no deadline (e.g. for Timer::one_shot())
+
 protected:
     Timer_Common() {}
 
@@ -21,7 +21,7 @@ class Thread
     friend class Init_End;              // context->load()
     friend class Init_System;           // for init() on CPU != 0
     friend class Scheduler<Thread>;     // for link()
-    friend class Synchronizer_Common;   // for lock() and sleep()
+    friend class Synchronizer_Common;   // for sleep(), wakeup() and deliver()
     friend class Alarm;                 // for lock()
     friend class System;                // for init()
     friend class EAMQ;                  // for handle()
@@ -35,6 +35,8 @@ protected:
     static const int priority_inversion_protocol = Traits<Thread>::priority_inversion_protocol;
     static const unsigned int QUANTUM = Traits<Thread>::QUANTUM;
     static const unsigned int STACK_SIZE = Traits<Application>::STACK_SIZE;
+    static const unsigned int LOCKS = Traits<Thread>::Criterion::QUEUES_CORES;
+    static const unsigned long ALL_LOCKS = (1UL << LOCKS) - 1;
 
     typedef CPU::Log_Addr Log_Addr;
     typedef CPU::Context Context;
@@ -90,6 +92,9 @@ public:
 
     Task * task() const { return _task; }
 
+    // Per-thread PMU counters (the event set can be changed with pmu().events(); see PMU::Context)
+    PMU::Context & pmu() { return _pmu; }
+
     int join();
     void pass();
     void suspend();
@@ -102,36 +107,58 @@ public:
 
     // for_all_behind() is used to update the rank of all threads behind the current one
     // the first time it is called is when a thread is inserted in the scheduler
-    // but it can be called again if other threads changes their queue
+    // but it can be called again if other threads changes their queue.
+    // Each thread behind is first checked against its predecessor in O(1) (EAMQ::assure_behind());
+    // only those that no longer fit are re-ranked from scratch. Threads that end up in another
+    // queue have their own followers checked afterwards (worklist, no recursion), and the number
+    // of full re-ranks per call is bounded by the number of threads.
     void for_all_behind(Criterion::Event event) {
-        this->criterion().is_recent_insertion(true);
-   
-        for (Queue::Element * behind = _link.next(); behind != nullptr;)
+        unsigned int budget = _thread_count;
+        Thread * work = 0;
+
+        for (Thread * from = this; from != nullptr;)
         {
-            // if finds a aperiodic thread, stop
-            if (!behind->object()->criterion().periodic()) break;
+            from->criterion().is_recent_insertion(true);
+
+            for (Queue::Element * behind = from->_link.next(); behind != nullptr;)
+            {
+                Thread * t = behind->object();
+
+                // if finds a aperiodic thread, stop
+                if (!t->criterion().periodic()) break;
+
+                // next element to be evaluated
+                Queue::Element * next = behind->next();
 
-            // next element to be evaluated
-            Queue::Element * next = behind->next();
+                // queue the thread is in before being re-ranked
+                unsigned int queue = t->criterion().queue_eamq();
 
-            // throws event to the thread
-            behind->object()->criterion().handle(event);
+                // throws event to the thread
+                t->criterion().handle(event);
 
-            // remove the thread from the scheduler
-            _scheduler.remove(behind->object());
+                // still fits behind its predecessor: only its waiting time changes (order is kept)
+                if (!t->criterion().assure_behind(behind->prev() ? behind->prev()->object() : nullptr) && budget) {
+                    budget--;
 
-            // recalculates the rank of the thread
-            behind->object()->criterion().rank_eamq();
+                    // recalculates the rank of the thread (it stays linked, search_t_fitted() skips it)
+                    t->criterion().rank_eamq();
 
-            // insert thread in new position (or in the old one)
-            _scheduler.insert(behind->object());
+                    // if the thread has changed its queue, it is necessary to check the new previous ones
+                    if (t->criterion().queue_eamq() != queue) {
+                        t->_cascade = work;
+                        work = t;
+                    }
+                }
 
-            // if the thread has changed its queue, it is necessary to check the new previous ones
-            if (this->criterion().queue_eamq() != behind->object()->criterion().queue_eamq()) {
-                behind->object()->for_all_behind(event);
+                // moves the thread to its new position (or keeps it in the old one)
+                _scheduler.rerank(t, queue);
+
+                behind = next;
             }
 
-            behind = next;
+            from = work;
+            if (work)
+                work = work->_cascade;
         }
     }
     alignas (int) static bool _not_booting;
@@ -152,27 +179,93 @@ protected:
         }
     }
 
+    // There is one scheduler lock per core queue (a single one for non-partitioned criteria).
+    // lock() takes all of them, always in ascending order, and must be used by anything that touches
+    // more than one queue or shared structures (synchronizers, alarms, remote wakeups, thread creation).
+    // lock(queue) takes only the lock of one core queue and is meant for the per-core paths (quantum
+    // tick, rescheduling IPI, yield). A CPU holding a single lock never waits for another one (see
+    // dispatch() for migration), so the order cannot be inverted. unlock() releases whatever the
+    // current CPU holds.
     static void lock() {
         CPU::int_disable();
-        if(smp)
-            _lock.acquire();
+        if(smp) {
+            assert(!_locked_by[CPU::id()] || (_locked_by[CPU::id()] == ALL_LOCKS)); // lock order
+            acquire(ALL_LOCKS);
+        }
+    }
+
+    static void lock(unsigned int queue) {
+        CPU::int_disable();
+        if(smp) {
+            assert(!_locked_by[CPU::id()] || (_locked_by[CPU::id()] & (1UL << (queue % LOCKS)))); // lock order
+            acquire(1UL << (queue % LOCKS));
+        }
     }
 
     static void unlock() {
         if(smp)
-            _lock.release();
+            release(_locked_by[CPU::id()]);
         if(_not_booting)
             CPU::int_enable();
     }
 
-    static volatile bool locked() { return (smp) ? _lock.taken() : CPU::int_disabled(); }
+    static volatile bool locked() { return (smp) ? (_locked_by[CPU::id()] != 0) : CPU::int_disabled(); }
+    static volatile bool locked(unsigned int queue) { return (smp) ? (_locked_by[CPU::id()] & (1UL << (queue % LOCKS))) : CPU::int_disabled(); }
+
+    static void acquire(unsigned long locks) {
+        for(unsigned int i = 0; i < LOCKS; i++)
+            if(locks & (1UL << i))
+                _lock[i].acquire();
+        _locked_by[CPU::id()] |= locks;
+    }
+
+    static bool try_acquire(unsigned long lock) {
+        for(unsigned int i = 0; i < LOCKS; i++)
+            if(lock & (1UL << i)) {
+                if(!_lock[i].try_acquire())
+                    return false;
+                _locked_by[CPU::id()] |= lock;
+                return true;
+            }
+        return false;
+    }
+
+    static void release(unsigned long locks) {
+        for(unsigned int i = 0; i < LOCKS; i++)
+            if(locks & (1UL << i)) {
+                if(_lock[i].level() <= 1)
+                    _locked_by[CPU::id()] &= ~(1UL << i);
+                _lock[i].release();
+            }
+    }
 
-    static void sleep(Queue * q);
+    // q is protected by guard, the lock of its synchronizer, which sleep() releases once the thread is in q
+    static void sleep(Queue * q, Spin * guard);
     static void wakeup(Queue * q);
     static void wakeup_all(Queue * q);
+    static void deliver();
+
+    // Wakeups go through a lock-free inbox per core: the waker only pushes the thread and, for other
+    // cores, sends INT_RESCHEDULER; the owner core inserts it (drain()) in rescheduler() or, for wakeups
+    // issued on the core itself, in deliver(). A posted thread stays WAITING with no _waiting queue until then.
+    bool remote() { return smp && (LOCKS > 1) && ((_link.rank().queue() % LOCKS) != (CPU::id() % LOCKS)); }
+    bool posted() { return (_state == WAITING) && !_waiting; }
+    static void post(Thread * t);
+    static void drain(unsigned int queue);
+    static bool steal();
+    static void balance();
+    bool settle(); // takes a posted thread out of its core's inbox, leaving it SUSPENDED; false if it was not posted
 
     static void reschedule();
     static void reschedule(unsigned int cpu);
+    static void reschedule_cpus(unsigned long cpus); // one multicast IPI for all the CPUs in the bitmap
+    // Batched wakeups (see Alarm::expire()): while on, the reschedules requested by wakeup() and wakeup_all() are only
+    // collected, and batch(false) sends them, once per core
+    static void batch(bool on);
+    static void reschedule_or_batch(unsigned long cpus);
+    // Programs this core's one-shot timer up to the next alarm or the end of the time slice (periodic again when
+    // more than one queue competes for the core)
+    static void tickless(bool idle);
     static void rescheduler(IC::Interrupt_Id interrupt);
     static void time_slicer(IC::Interrupt_Id interrupt);
 
@@ -197,13 +290,25 @@ protected:
     volatile State _state;
     Criterion _natural_priority;
     Queue * _waiting;
+    Spin * _guard;             // the lock of the synchronizer _waiting belongs to
     Thread * volatile _joining;
     Queue::Element _link;
+    Thread * volatile _posted; // next thread in the same remote wakeup inbox
+    Thread * _cascade;         // next thread in the for_all_behind() worklist
+    PMU::Context _pmu;         // saved and loaded by dispatch()
 
     static volatile unsigned int _thread_count;
     static Scheduler_Timer * _timer;
     static Scheduler<Thread> _scheduler;
-    static Spin _lock;
+    static Spin _lock[LOCKS];
+    static volatile unsigned long _locked_by[Traits<Machine>::CPUS]; // scheduler locks held by each CPU (bit i => _lock[i])
+    static Thread * volatile _inbox[Traits<Machine>::CPUS]; // remote wakeups waiting to be inserted by their core (see post())
+    // INT_RESCHEDULER sent (or, for a core waiting on it in Idle_Manager, the flag written) but not yet acknowledged;
+    // one cache line per core, so writing one flag does not wake the other monitoring cores
+    struct Wakeup { volatile bool pending; } __attribute__((aligned(64)));
+    static Wakeup _reschedule_pending[Traits<Machine>::CPUS];
+    static bool _batching[Traits<Machine>::CPUS];
+    static unsigned long _batched[Traits<Machine>::CPUS]; // cores to reschedule when the batch ends
 };
 
 class Task
@@ -265,7 +370,7 @@ private:
 
 template<typename ... Tn>
 inline Thread::Thread(int (* entry)(Tn ...), Tn ... an)
-: _task(Task::self()), _state(READY), _waiting(0), _joining(0), _link(this, NORMAL)
+: _task(Task::self()), _state(READY), _waiting(0), _guard(0), _joining(0), _link(this, NORMAL), _posted(0), _cascade(0)
 {
     constructor_prologue(STACK_SIZE);
     _context = CPU::init_stack(0, _stack + STACK_SIZE, &__exit, entry, an ...);
@@ -274,7 +379,7 @@ inline Thread::Thread(int (* entry)(Tn ...), Tn ... an)
 
 template<typename ... Tn>
 inline Thread::Thread(Configuration conf, int (* entry)(Tn ...), Tn ... an)
-: _task(Task::self()), _state(conf.state), _waiting(0), _joining(0), _link(this, conf.criterion)
+: _task(Task::self()), _state(conf.state), _waiting(0), _guard(0), _joining(0), _link(this, conf.criterion), _posted(0), _cascade(0)
 {
     constructor_prologue(conf.stack_size);
     _context = CPU::init_stack(0, _stack + conf.stack_size, &__exit, entry, an ...);
@@ -62,8 +62,9 @@ protected:
 public:
     struct Configuration: public Thread::Configuration {
         Configuration(Microsecond p, Microsecond d = SAME, Microsecond c = UNKNOWN, Microsecond a = NOW, const unsigned int n = INFINITE, State s = READY, unsigned int ss = STACK_SIZE)
-        : Thread::Configuration(s, Criterion(p, d, c), ss), activation(a), times(n) {}
+        : Thread::Configuration(s, Criterion(p, d, c), ss), period(p), activation(a), times(n) {}
 
+        Microsecond period; // as given (the criterion keeps it in ticks, which high-resolution alarms need not be)
         Microsecond activation;
         unsigned int times;
     };
@@ -72,7 +73,8 @@ public:
     template<typename ... Tn>
     Periodic_Thread(Microsecond p, int (* entry)(Tn ...), Tn ... an)
     : Thread(Thread::Configuration(SUSPENDED, Criterion(p)), entry, an ...),
-      _semaphore(0), _handler(&_semaphore, this), _alarm(p, &_handler, INFINITE) {
+      _semaphore(0), _handler(&_semaphore, this), _alarm(p, &_handler, INFINITE, criterion().queue()) {
+        _alarm.batched(true);
         resume();
         criterion().handle(Criterion::JOB_RELEASE);
     }
@@ -80,7 +82,8 @@ public:
     template<typename ... Tn>
     Periodic_Thread(Configuration conf, int (* entry)(Tn ...), Tn ... an)
     : Thread(Thread::Configuration(SUSPENDED, conf.criterion, conf.stack_size), entry, an ...),
-      _semaphore(0), _handler(&_semaphore, this), _alarm(conf.criterion.period(), &_handler, conf.times) {
+      _semaphore(0), _handler(&_semaphore, this), _alarm(conf.period, &_handler, conf.times, criterion().queue()) {
+        _alarm.batched(true);
         if((conf.state == READY) || (conf.state == RUNNING)) {
             _state = SUSPENDED;
             resume();
@@ -95,7 +98,14 @@ public:
     static volatile bool wait_next() {
         Periodic_Thread * t = reinterpret_cast<Periodic_Thread *>(running());
 
+        // JOB_FINISH shifts the ranks of the thread's queue, which the time slicer, balance() and steal() also walk
+        lock(t->criterion().queue());
         t->criterion().handle(Criterion::JOB_FINISH);
+        unlock();
+
+        // Releases are handled by the core the thread is partitioned to, so a migrated thread takes its alarm along
+        if(t->_alarm.cpu() != t->criterion().queue())
+            t->_alarm.cpu(t->criterion().queue());
 
         if(t->_alarm.times()) {
             t->_semaphore.p();}
@@ -126,8 +136,10 @@ private:
             t->criterion().handle(Criterion::JOB_RELEASE);
 
             // Adjust alarm's period
+            Microsecond p = t->_alarm.period();
             t->_alarm.~Alarm();
-            new (&t->_alarm) Alarm(t->criterion().period(), &t->_handler, n);
+            new (&t->_alarm) Alarm(p, &t->_handler, n, t->criterion().queue());
+            t->_alarm.batched(true);
         }
 
         // Periodic execution loop
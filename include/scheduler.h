@@ -6,6 +6,8 @@
 #include <architecture/cpu.h>
 #include <architecture/pmu.h>
 #include <architecture/tsc.h>
+#include <dvfs.h>
+#include <energy.h>
 #include <utility/scheduling.h>
 #include <utility/math.h>
 #include <utility/convert.h>
@@ -80,7 +82,20 @@ public:
     static const bool dynamic = false;
     static const bool preemptive = true;
     static const bool migration = false;
+    static const bool lazy_update = false; // true => UPDATE is accounted by elapse() instead of being sent to every ready thread at each dispatch
     static const unsigned int QUEUES = 1;
+    static const unsigned int QUEUES_CORES = 1; // partitioned criteria keep one scheduling queue (and one scheduler lock) per core
+    static const bool metered = false; // true => the energy spent by each thread is reported to it (consume()) at dispatch
+    static const bool monitored = false; // true => the PMU counts of each thread (PMU::Context) are reported to it (account()) at dispatch
+
+    static const bool stealing = false; // true => an idle core pulls a ready thread from the most loaded core before sleeping (see Thread::steal())
+    static const bool balanced = false; // true => threads are pushed from the most to the least loaded core every few quanta (see Thread::balance())
+
+    static void elapse() {}
+    static unsigned int victim() { return ANY; }
+    static Thread * stealable(unsigned int core, unsigned int to) { return 0; }
+    static bool sample() { return false; }
+    static unsigned long balance() { return 0; }
 
     // Runtime Statistics (for policies that don't use any; that's why its a union)
     union Dummy_Statistics
@@ -141,6 +156,8 @@ protected:
     void handle(Event event) {}
     void queue(unsigned int q) {}
     void update() {}
+    void consume(unsigned long long energy) {}
+    void account(const PMU::Context & pmu) {}
 
     static void init() {}
 
@@ -360,11 +377,27 @@ class EAMQ : public RT_Common
 {
 
 public:
-    static const unsigned short QUEUES = 4;
+    typedef Traits<EAMQ>::Ladder Ladder;
+
+    static const unsigned short QUEUES = Ladder::STEPS;
     static const unsigned int Q = Traits<Thread>::QUANTUM;
     static const bool dynamic = true;
+    static const bool lazy_update = true;
+    static const bool metered = Energy_Meter::enabled;
+    static const bool monitored = Traits<PMU>::enabled;
 
     typedef PMU_Common::Count Count;
+    typedef Energy_Meter::Energy Energy;
+
+    // Eventos da PMU lidos em account() (indices de PMU::config(), os mesmos de CPU::init() e de PMU::Context())
+    enum : PMU::Event
+    {
+        PMU_INSTRUCTIONS = 2,
+        PMU_BRANCH_MISS = 15,
+        PMU_BRANCHES = 11,
+        PMU_CACHE_HIT = 24,
+        PMU_CACHE_MISS = 25
+    };
 
 public:
     EAMQ(int p = APERIODIC);
@@ -381,6 +414,8 @@ public:
     struct Personal_Statistics
     {
         Microsecond remaining_deadline;         // deadline restante 
+        Energy energy_consumed;                 // energia gasta pela thread (Energy_Meter::microjoules() converte)
+        Energy job_energy;                      // energia gasta pelo job atual (ou pelo ultimo, depois de JOB_FINISH)
         Microsecond remaining_et[QUEUES];       // tempo de execucao restante em cada frequencia (inicia como job_estimated_et)
         Microsecond job_estimated_et[QUEUES];   // tempo de execução estimado em cada frequencia dada media
         Microsecond average_et[QUEUES];         // tempo de execução média ponderada
@@ -404,33 +439,86 @@ public:
 
     Personal_Statistics personal_statistics() { return _personal_statistics; }
 
-    const bool is_recent_insertion() { return _is_recent_insertion; }
-    void is_recent_insertion(bool b) { _is_recent_insertion = b; }
+    // Protecao das recem inseridas vale ate o proximo quantum da subfila (geracao = _quanta)
+    const bool is_recent_insertion() { return _is_recent_insertion && (_recent_epoch == now()); }
+    void is_recent_insertion(bool b) { _is_recent_insertion = b; _recent_epoch = now(); }
     const bool periodic() { return _periodic; }
 
+    // Por job: corre na frequencia maxima e dorme (RACE), estica numa subfila mais lenta (STRETCH)
+    // ou escolhe pelo modelo de energia (ADAPTIVE)
+    enum Stretch { STRETCH, RACE, ADAPTIVE };
+    static Stretch stretch() { return _stretch; }
+    static void stretch(Stretch s) { _stretch = s; }
+
     int rank_eamq();
+    bool assure_behind(Thread * ahead);
     const volatile unsigned int &queue_eamq() const volatile { return _queue_eamq; } // returns the Thread's queue
 
+    // Contabilidade preguicosa do UPDATE: em vez de decrementar remaining_deadline de todas as threads
+    // prontas a cada dispatch, cada core conta os quanta de cada subfila e a thread guarda o valor do
+    // contador (_epoch) em que seu remaining_deadline foi atualizado pela ultima vez
+    static void elapse() { _quanta[CPU::id()][current_queue_eamq()]++; }
+    Microsecond remaining_deadline();
+
+    // Tabelas de frequencia e de conversao de tempo de execucao entre subfilas (dependem de CPU::max_clock())
+    static void init();
+
     static const volatile unsigned int &current_queue_eamq() { return _current_queue[CPU::id()]; } // current global queue
     virtual void next_queue() { ++_current_queue[CPU::id()] %= QUEUES;}        // points to next global queue with threads
     void reset_pmu_personal_stats();
 
-    void set_queue(unsigned int q) { _queue_eamq = q; };
+    void set_queue(unsigned int q);
+
+    // Energia gasta desde o ultimo dispatch (Thread::dispatch(), com metered)
+    void consume(Energy energy) { _personal_statistics.energy_consumed += energy; _personal_statistics.job_energy += energy; }
+
+    // Contagens da PMU do ultimo quantum da thread (Thread::dispatch(), com monitored)
+    void account(const PMU::Context & pmu);
 protected:
+    virtual unsigned int core() const { return 0; }
+    unsigned long now() const { return _quanta[core()][_queue_eamq]; }
+
+    // Consolida os quanta esperados na subfila em remaining_deadline (fold) ou so recomeca a contar (rebase)
+    void fold();
+    void rebase() { _epoch = now(); _accruing = true; }
+
+    // Antes e depois de trocar de contador (mudanca de subfila ou de core)
+    bool unbind() { bool recent = is_recent_insertion(); fold(); return recent; }
+    void bind(bool recent) { _epoch = now(); if(recent) _recent_epoch = _epoch; }
 
-    /* Em caso de 4 filas em relacao a frequencia maxima:
+
+    /* Frequencia de cada subfila em relacao a frequencia maxima, dada por Traits<EAMQ>::Ladder.
+     * Com o padrao (Linear_Ladder<4, 1250>):
      *   0 -> 100%
      *   1 -> 87%
      *   2 -> 75%
      *   3 -> 62%
      */
-    static Hertz frequency_within(unsigned int queue)
-    {
-        if (Traits<System>::RUN_TO_HALT) return CPU::max_clock(); 
+    static constexpr unsigned int share(unsigned int queue) { return Traits<System>::RUN_TO_HALT ? 10000 : Ladder::share(queue); }
+    static Hertz frequency_within(unsigned int queue) { return _frequency[queue]; }
 
-        Hertz f = CPU::max_clock() - (((CPU::max_clock() / 1000) * 125) * queue);
-        return f;
-    };
+    // Converte um tempo medido na frequencia da subfila from para a frequencia da subfila to
+    // (o mesmo que Timer_Common::sim(), mas com uma multiplicacao por um reciproco em ponto fixo)
+    static Microsecond scale(Microsecond t, unsigned int from, unsigned int to) {
+        return Microsecond((static_cast<unsigned long long>(Time_Base(t)) * _scale[from][to]) >> SCALE_SHIFT);
+    }
+
+    // O mesmo, mas so a parte de CPU escala com a frequencia: a fracao memory_bound do tempo (em 1/2^SCALE_SHIFT)
+    // e gasta esperando a memoria, que nao muda com o clock
+    static Microsecond scale(Microsecond t, unsigned int from, unsigned int to, unsigned long memory_bound) {
+        unsigned long long factor = ((static_cast<unsigned long long>(_scale[from][to]) * ((1UL << SCALE_SHIFT) - memory_bound)) >> SCALE_SHIFT) + memory_bound;
+        return Microsecond((static_cast<unsigned long long>(Time_Base(t)) * factor) >> SCALE_SHIFT);
+    }
+
+    /* Fracao do tempo de execucao parada em cache misses, estimada das estatisticas da PMU:
+     * misses * miss_penalty / (instructions + misses * miss_penalty), supondo CPI 1 fora dos misses
+     */
+    unsigned long memory_bound() const;
+
+    /* Decide, na liberacao do job, entre race-to-idle e stretch comparando a energia estimada
+     * de cada opcao dentro de remaining_deadline
+     */
+    bool race_to_idle();
 
     /* Procura pela melhor thread na subfila q (posicao a colocar), 
      * onde o slack seja o menor possivel
@@ -454,11 +542,23 @@ protected:
 protected:
     volatile unsigned int _queue_eamq;
     bool _is_recent_insertion;
+    unsigned long _recent_epoch;
     Personal_Statistics _personal_statistics;
     Thread *_behind_of;
+    bool _race;           // job atual vai para a subfila 0 e deixa o core dormir (ver race_to_idle())
     bool _periodic;
+    bool _accruing;       // esta em uma fila de prontos, acumulando quanta de espera
+    unsigned long _epoch; // _quanta[core()][_queue_eamq] quando remaining_deadline foi consolidado
+    unsigned long _memory_bound; // memory_bound() no ultimo JOB_FINISH, usado por scale() em LEAVE e JOB_FINISH
     static bool initialized;
 
+    static volatile unsigned long _quanta[Traits<Machine>::CPUS][QUEUES];
+    static Stretch _stretch;
+
+    static const unsigned int SCALE_SHIFT = 16;
+    static Hertz _frequency[QUEUES];
+    static unsigned long _scale[QUEUES][QUEUES]; // (f[from] << SCALE_SHIFT) / f[to]
+
     static volatile unsigned int _current_queue[Traits<Machine>::CPUS]; 
 };
 
@@ -507,13 +607,19 @@ public:
     // P7 : booleano para indicar se permite migrar thread ou não e se acabou de migrar
     static const bool migration = true;
     bool _recently_migrated = false;
+    // Roubo de trabalho: antes de dormir, um core ocioso puxa uma thread pronta do core mais carregado
+    static const bool stealing = Traits<EAMQ>::work_stealing;
+    // Balanceador periodico: a cada balance_period quanta empurra threads do core mais carregado para o menos
+    static const bool balanced = Traits<EAMQ>::balance_period > 0;
+    static const unsigned int LOAD_UNIT = 1024; // uma thread executavel, em _core_statistics.load
 
     PEAMQ(int p = APERIODIC)
     : Variable_Queue_Scheduler(((p == IDLE) || (p == MAIN)) ? CPU::id() : ++_next_queue %= CPU::cores()), EAMQ(p) {}
     PEAMQ(const Microsecond & p, const Microsecond & d = SAME, const Microsecond & c = UNKNOWN, unsigned int cpu = ANY)
-    : Variable_Queue_Scheduler((cpu != ANY) ? cpu : evaluate()), EAMQ(p, d, c) {}
+    : Variable_Queue_Scheduler((cpu != ANY) ? cpu : place()), EAMQ(p, d, c) {}
 
-    using Variable_Queue_Scheduler::queue;
+    const volatile unsigned int & queue() const volatile { return _queue; }
+    void queue(unsigned int q) { bool recent = unbind(); _queue = q; bind(recent); }
     static unsigned int current_queue() { return CPU::id(); }
 
     struct Core_Statistics 
@@ -523,35 +629,75 @@ public:
         unsigned long long instruction_retired[QUEUES_CORES];
         unsigned long long cache_hit[QUEUES_CORES];
         unsigned long long branch_instruction[QUEUES_CORES];
+        Energy energy[QUEUES_CORES];  // energia gasta pelas threads em cada core
 
         // P7 : core com mais nivel de utilização 
         unsigned int min_core;
         unsigned int max_core;
+
+        // Calculados por balance(), com decaimento exponencial (ver Traits<EAMQ>::balance_decay)
+        unsigned long load[QUEUES_CORES];           // threads executaveis (em LOAD_UNIT)
+        unsigned long pressure[QUEUES_CORES];       // fator de pressao da PMU (1 a 20, em 1/16)
+        unsigned long long score[QUEUES_CORES];     // load x pressure: define min_core e max_core
+        unsigned int min_near[QUEUES_CORES];        // core de menor score no dominio de cache (CPU::cache_domain()) de cada core
     };
 
     static Core_Statistics core_Statistics() { return _core_statistics; }
+    // O(1): min_core e max_core sao recalculados a cada balance()
+    static unsigned int evaluate(bool max_core = false) { return max_core ? _core_statistics.max_core : _core_statistics.min_core; }
+    // Destino de uma migracao a partir de core: com cache_affinity, sem sair do dominio de cache dele
+    static unsigned int evaluate_near(unsigned int core) { return Traits<EAMQ>::cache_affinity ? _core_statistics.min_near[core] : _core_statistics.min_core; }
+    static bool near(unsigned int a, unsigned int b) { return CPU::cache_domain(a) == CPU::cache_domain(b); }
     
     void handle(Event event) override;
     bool migrate();
+    static unsigned int victim();
+    static Thread * stealable(unsigned int core, unsigned int to);
+    static bool sample();
+    static unsigned long balance();
+    void consume(Energy energy) { EAMQ::consume(energy); _core_statistics.energy[CPU::id()] += energy; }
+    void account(const PMU::Context & pmu);
 
 protected:
-    volatile unsigned int evaluate(bool max_core=false);
+    unsigned int core() const override { return _queue; }
+
+    static unsigned int place();
+
     static Core_Statistics _core_statistics;
+
+private:
+    // Contadores de cada core no ultimo balance(), para medir so a janela desde entao
+    struct Window
+    {
+        unsigned long demand;
+        unsigned long samples;
+        unsigned long long instructions;
+        unsigned long long branches;
+        unsigned long long branch_misses;
+        unsigned long long cache_hits;
+        unsigned long long cache_misses;
+    };
+
+    static volatile unsigned long _demand[QUEUES_CORES];   // soma das threads executaveis amostradas a cada quantum (sample())
+    static volatile unsigned long _samples[QUEUES_CORES];
+    static volatile unsigned long _balance_quanta;          // quanta de todos os cores, para o periodo do balanceador
+    static Window _window[QUEUES_CORES];
 };
 
 __END_SYS
 
 __BEGIN_UTIL
 
+// Traits<EAMQ>::indexed_queues selects between the original ordered sub-queues and the splay-tree-indexed ones (for A/B testing)
 template<typename T>
-class Scheduling_Queue<T, PEAMQ> : public Multilist_Scheduling_Multilist<T>{};
+class Scheduling_Queue<T, PEAMQ> : public IF<Traits<EAMQ>::indexed_queues, Indexed_Multilist_Scheduling_Multilist<T>, Multilist_Scheduling_Multilist<T>>::Result {};
 
 // P3TEST - usando multihead multilist
 template <typename T>
 class Scheduling_Queue<T, GEAMQ> : public Multihead_Scheduling_Multilist<T>{};
 
 template <typename T>
-class Scheduling_Queue<T, EAMQ> : public Scheduling_Multilist_Single_Chosen<T>{};
+class Scheduling_Queue<T, EAMQ> : public IF<Traits<EAMQ>::indexed_queues, Indexed_Scheduling_Multilist_Single_Chosen<T>, Scheduling_Multilist_Single_Chosen<T>>::Result {};
 // Scheduling Queues
 template<typename T>
 class Scheduling_Queue<T, GRR>:
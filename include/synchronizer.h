@@ -24,15 +24,18 @@ protected:
     long fdec(volatile long & number) { return CPU::fdec(number); }
 
     // Thread operations
-    void begin_atomic() { Thread::lock(); }
-    void end_atomic() { Thread::unlock(); }
+    // The waiting queue has a lock of its own: wakers only post threads to the inbox of their cores (see Thread::post()),
+    // so the only scheduler lock taken is that of this core, to insert the threads posted here (see Thread::deliver())
+    void begin_atomic() { CPU::int_disable(); _lock.acquire(); }
+    void end_atomic() { _lock.release(); Thread::deliver(); if(Thread::_not_booting) CPU::int_enable(); }
 
-    void sleep() { Thread::sleep(&_queue); }
+    void sleep() { Thread::sleep(&_queue, &_lock); begin_atomic(); } // Thread::sleep() releases _lock
     void wakeup() { Thread::wakeup(&_queue); }
     void wakeup_all() { Thread::wakeup_all(&_queue); }
 
 protected:
     Queue _queue;
+    Spin _lock;
 };
 
 
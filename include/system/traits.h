@@ -115,6 +115,31 @@ class LLF;
 class EAMQ;
 class GEAMQ;
 class PEAMQ;
+template<unsigned int Q, unsigned int STEP> class Linear_Ladder;
+template<unsigned int Q> class Clock_Modulation_Ladder;
+template<unsigned int ... P> class Table_Ladder;
+
+// Default configuration of EAMQ and PEAMQ: applications derive their Traits<EAMQ> from it and override only what differs
+struct EAMQ_Defaults
+{
+    static const bool indexed_queues = true; // rank-indexed sub-queues (false => original ordered lists)
+    static const bool work_stealing = true; // an idle core pulls a ready thread from the most loaded core (PEAMQ only)
+    static const unsigned int balance_period = 8;  // quanta (per core) between two runs of the PEAMQ load balancer (0 => disabled)
+    static const unsigned int balance_decay = 2;   // the balancer weighs each new load and PMU pressure sample by 1/2^decay
+    static const unsigned int balance_batch = 2;   // threads the balancer may push at once
+    static const bool cache_affinity = true;       // PEAMQ placement, migration and balancing keep cache-hungry threads within the cache domain (shared L2) of their core
+
+    // Sub-queue operating points, in 1/10000 of CPU::max_clock(), fastest first; its size is EAMQ::QUEUES
+    // (Linear_Ladder<Q, STEP>, Clock_Modulation_Ladder<Q> or Table_Ladder<10000, ...>)
+    typedef Linear_Ladder<4, 1250> Ladder;
+
+    static const bool dvfs = true;                  // apply the sub-queue frequencies with CPU::clock() (through DVFS_Governor)
+    static const unsigned int dvfs_hysteresis = 2;  // consecutive slow-down requests before lowering the clock
+    static const bool energy = true;                // model-based energy accounting per thread and per core (Energy_Meter)
+    static const unsigned int miss_penalty = 200;   // cycles a cache miss stalls (its time does not scale with the clock; 0 => linear scaling)
+    static const unsigned int profiler_period = 0;  // unhalted cycles between two samples of the PMU sampling profiler (0 => disabled)
+    static const unsigned int profiler_samples = 256; // per-core ring buffer of the profiler
+};
 class AAA;
 class GRR;
 class Fixed_CPU;
@@ -7,6 +7,8 @@
 #include <machine/timer.h>
 #include <process.h>
 #include <utility/queue.h>
+#include <utility/list.h>
+#include <utility/math.h>
 #include <utility/handler.h>
 #include <utility/spin.h>
 
@@ -36,15 +38,37 @@ class Alarm
     friend class FCFS;                          // for elapsed()
     friend class Thread;                        // for elapsed()
     friend class RT_Common;                     // for elapsed()
-    friend class Periodic_Thread;               // for times()
+    friend class Periodic_Thread;               // for times() and batched()
+    friend class RT_Thread;                     // for batched()
     friend class EDF;                           // for ticks() and elapsed()
 
 private:
     typedef Timer_Common::Tick Tick;
-    typedef Relative_Queue<Alarm, Tick> Queue;
+    typedef TSC::Time_Stamp Time_Stamp;
+    // The rank is only used in high-resolution mode, as the absolute expiration in TSC cycles
+    typedef List_Elements::Doubly_Linked_Ordered<Alarm, Time_Stamp> Element;
+    typedef List<Alarm, Element> Queue;
+    typedef Ordered_List<Alarm, Time_Stamp, Element> Near;
+
+    // Hierarchical timing wheel: level l has SLOTS slots of SLOTS^l ticks each, so insert and
+    // cancel are O(1) and alarms further than HORIZON just wrap around the last level again
+    static const unsigned int SLOT_BITS = 5;
+    static const unsigned int SLOTS = 1 << SLOT_BITS;
+    static const unsigned int MASK = SLOTS - 1;
+    static const unsigned int LEVELS = 5;
+    static const Tick HORIZON = (Tick(1) << (SLOT_BITS * LEVELS)) - 1;
+    static_assert(SLOTS <= 32, "Alarm wheel slots are indexed by an unsigned int bitmap");
+
+    // Each core has its own wheel, advanced by its own timer, so alarms fire on the core that will run their handlers
+    static const unsigned int CPUS = Traits<Machine>::CPUS;
+
+    // High resolution: alarms expire at exact TSC times; the wheel only takes them to the tick they expire in,
+    // when they move to an ordered list and the timer is programmed to interrupt at the first of them
+    static const bool high_resolution = Timer::high_resolution;
 
 public:
-    Alarm(Microsecond time, Handler * handler, unsigned int times = 1);
+    Alarm(Microsecond time, Handler * handler, unsigned int times = 1) : Alarm(time, handler, times, CPU::id()) {}
+    Alarm(Microsecond time, Handler * handler, unsigned int times, unsigned int cpu);
     ~Alarm();
 
     const Microsecond & period() const { return _time; }
@@ -52,6 +76,9 @@ public:
 
     void reset();
 
+    unsigned int cpu() const { return _cpu; }
+    void cpu(unsigned int c);
+
     static Hertz frequency() { return _timer->frequency(); }
 
     static void delay(Microsecond time);
@@ -59,16 +86,46 @@ public:
 private:
     unsigned int times() const { return _times; }
 
-    static volatile Tick & elapsed() { return _elapsed; }
+    // The handler only wakes threads up (e.g. a Periodic_Thread's job release), so it can run in a batch (see expire())
+    void batched(bool b) { _batched = b; }
+
+    // The BSP's tick count, which is the system time base
+    static volatile Tick & elapsed() { return _now[CPU::BSP]; }
 
     static Alarm_Timer * timer() { return _timer; }
 
     static Tick ticks(Microsecond time) { return Timer_Common::ticks(time, frequency()); }
-
+    static Time_Stamp cycles(Microsecond time) { return Time_Stamp(time) * CPU::max_clock() / 1000000; }
+    // The tick of cpu in which expiration falls (never after it)
+    static Tick tick(unsigned int cpu, const Time_Stamp & expiration);
+
+    // Time until the next alarm of this core fires (INFINITE if there is none), for Thread::idle()
+    static Microsecond next();
+    // The same in ticks (Timer::FOREVER if there is none), for the tickless Timer
+    static Tick next_tick();
+    // A new alarm may expire before the one-shot tick armed on its core (see Thread::tickless())
+    static void rearm(Alarm * alarm);
+
+    // Lower bound for the ticks until the next alarm, read without the lock (wheel levels above 0 yield their cascade tick)
+    static Tick pending(unsigned int cpu);
+
+    // Wheel operations (with the lock of the alarm's core held)
+    static void enqueue(Alarm * alarm);
+    static void dequeue(Alarm * alarm);
+    static void cascade(unsigned int cpu, unsigned int level, unsigned int slot);
+    // Moves the expired alarms of the ordered list to _due and programs the timer for the next one
+    static void release(unsigned int cpu);
+    // Runs the handlers of all due alarms of cpu, each outside the lock (or in a batch, for batched alarms)
+    static void expire(unsigned int cpu);
+    static Alarm * next_due(unsigned int cpu);
+
+    // The wheel of a core is protected by the scheduler lock of that core, which its handlers need anyway
     static void lock() { Thread::lock(); }
+    static void lock(unsigned int cpu) { Thread::lock(cpu); }
     static void unlock() { Thread::unlock(); }
 
     static void handler(IC::Interrupt_Id i);
+    static void precise(IC::Interrupt_Id i);
 
     static void init();
 
@@ -77,11 +134,20 @@ private:
     Handler * _handler;
     unsigned int _times;
     Tick _ticks;
+    Time_Stamp _cycles;
+    Tick _deadline; // in ticks of _cpu
+    unsigned int _cpu;
+    bool _batched;
+    Queue * _slot; // the wheel slot (or _due) holding _link, 0 if none
     Queue::Element _link;
 
     static Alarm_Timer * _timer;
-    static volatile Tick _elapsed;
-    static Queue _request;
+    static volatile Tick _now[CPUS];
+    static volatile Tick _armed[CPUS];
+    static Queue _wheel[CPUS][LEVELS][SLOTS];
+    static volatile unsigned int _occupied[CPUS][LEVELS];
+    static Near _near[CPUS];
+    static Queue _due[CPUS];
 };
 
 
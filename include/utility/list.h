@@ -4,6 +4,7 @@
 #define __list_h
 
 #include <system/config.h>
+#include <utility/math.h>
 
 __BEGIN_UTIL
 
@@ -291,6 +292,60 @@ namespace List_Elements
         Element *_next;
     };
 
+    // Indexed Scheduling List Element
+    // A Doubly_Linked_Scheduling that can also be a node of Indexed_Ordered_List's splay tree
+    template <typename T, typename R = Rank>
+    class Doubly_Linked_Indexed_Scheduling
+    {
+    public:
+        typedef T Object_Type;
+        typedef R Rank_Type;
+        typedef Doubly_Linked_Indexed_Scheduling Element;
+
+    public:
+        Doubly_Linked_Indexed_Scheduling(const T *o, const R &r = 0)
+        : _object(o), _rank(r), _prev(0), _next(0), _left(0), _right(0), _key(0), _order(0) {}
+
+        T *object() const { return const_cast<T *>(_object); }
+
+        Element *prev() const { return _prev; }
+        Element *next() const { return _next; }
+        void prev(Element *e) { _prev = e; }
+        void next(Element *e) { _next = e; }
+
+        const R &rank() const { return _rank; }
+        void rank(const R &r) { _rank = r; }
+        int promote(const R &n = 1)
+        {
+            _rank -= n;
+            return _rank;
+        }
+        int demote(const R &n = 1)
+        {
+            _rank += n;
+            return _rank;
+        }
+
+        // Index (see Indexed_Ordered_List)
+        Element *left() const { return _left; }
+        Element *right() const { return _right; }
+        void left(Element *e) { _left = e; }
+        void right(Element *e) { _right = e; }
+        int key() const { return _key; }
+        unsigned long order() const { return _order; }
+        void key(int k, unsigned long o) { _key = k; _order = o; }
+
+    private:
+        const T *_object;
+        R _rank;
+        Element *_prev;
+        Element *_next;
+        Element *_left;
+        Element *_right;
+        int _key;
+        unsigned long _order;
+    };
+
     // Grouping List Element
     template <typename T>
     class Doubly_Linked_Grouping
@@ -953,6 +1008,22 @@ protected:
         print_tail();
     }
 
+    void insert_after(Element *e, Element *p)
+    {
+        if (p->next())
+            insert(e, p, p->next());
+        else
+            insert_tail(e);
+    }
+
+    void insert_before(Element *e, Element *n)
+    {
+        if (n->prev())
+            insert(e, n->prev(), n);
+        else
+            insert_head(e);
+    }
+
     void insert_first(Element *e)
     {
         db<Lists>(TRC) << "List::insert_first(e=" << e
@@ -1118,6 +1189,47 @@ public:
             return 0;
     }
 
+    // The ranks of all elements were lowered by n in place, which keeps their
+    // order; ranks are read from the elements, so there is nothing to adjust
+    void shift(int n) {}
+
+    // Moves e, still linked, to the position its rank (changed in place) now
+    // requires, walking only from where it is: towards the head on a decrease,
+    // towards the tail on an increase
+    void rerank(Element *e)
+    {
+        db<Lists>(TRC) << "Ordered_List::rerank(e=" << e
+                       << ") => {p=" << (e ? e->prev() : (void *)-1)
+                       << ",o=" << (e ? e->object() : (void *)-1)
+                       << ",n=" << (e ? e->next() : (void *)-1)
+                       << "}" << endl;
+
+        assert(!relative);
+
+        Element *p = e->prev();
+        Element *n = e->next();
+        if (p && (p->rank() > e->rank()))
+        {
+            while (p && (p->rank() > e->rank()))
+                p = p->prev();
+            Base::remove(e);
+            if (p)
+                Base::insert_after(e, p);
+            else
+                insert_head(e);
+        }
+        else if (n && (n->rank() <= e->rank()))
+        {
+            while (n && (n->rank() <= e->rank()))
+                n = n->next();
+            Base::remove(e);
+            if (n)
+                Base::insert_before(e, n);
+            else
+                insert_tail(e);
+        }
+    }
+
     Element *search_rank(const Rank_Type &rank)
     {
         Element *e = head();
@@ -1145,6 +1257,210 @@ class Relative_List : public Ordered_List<T, R, El, true>
 {
 };
 
+// Doubly-Linked, Indexed Ordered List
+// Keeps the same ordering (and FIFO among equal ranks) as Ordered_List, but
+// also links the elements in a splay tree keyed by (rank, insertion order).
+// insert() splays the new key to find its neighbor in the list and remove()
+// splays the element out, both in amortized O(log n) whatever the ranks are;
+// head() and tail() are O(1). The key is the rank at insertion, so a rank
+// changed in place (e.g. EAMQ's JOB_FINISH) only counts after rerank().
+// Elements must provide the index of Doubly_Linked_Indexed_Scheduling.
+template <typename T,
+          typename R = List_Element_Rank,
+          typename El = List_Elements::Doubly_Linked_Indexed_Scheduling<T, R>>
+class Indexed_Ordered_List : public List<T, El>
+{
+private:
+    typedef List<T, El> Base;
+
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+    typedef List_Iterators::Bidirecional<El> Iterator;
+
+public:
+    Indexed_Ordered_List() : _root(0), _order(0) {}
+
+    using Base::begin;
+    using Base::empty;
+    using Base::end;
+    using Base::head;
+    using Base::search;
+    using Base::size;
+    using Base::tail;
+
+    void insert(Element *e)
+    {
+        db<Lists>(TRC) << "Indexed_Ordered_List::insert(e=" << e
+                       << ") => {o=" << (e ? e->object() : (void *)-1)
+                       << ",r=" << (e ? int(e->rank()) : -1)
+                       << "}" << endl;
+
+        e->key(e->rank(), _order++);
+
+        if (!_root)
+        {
+            e->left(0);
+            e->right(0);
+            Base::insert_tail(e);
+            _root = e;
+            return;
+        }
+
+        // e is not in the tree, so the splay ends at its predecessor or at its successor
+        Element *t = splay(_root, e);
+        if (less(t, e))
+        {
+            Base::insert_after(e, t);
+            e->left(t);
+            e->right(t->right());
+            t->right(0);
+        }
+        else
+        {
+            Base::insert_before(e, t);
+            e->right(t);
+            e->left(t->left());
+            t->left(0);
+        }
+        _root = e;
+    }
+
+    Element *remove() { return remove_head(); }
+
+    Element *remove(Element *e)
+    {
+        db<Lists>(TRC) << "Indexed_Ordered_List::remove(e=" << e
+                       << ") => {o=" << (e ? e->object() : (void *)-1)
+                       << ",r=" << (e ? int(e->rank()) : -1)
+                       << "}" << endl;
+
+        Element *t = splay(_root, e);
+        if (t->left())
+        {
+            // e's predecessor has no right child once splayed to the top of e's left subtree
+            _root = splay(t->left(), e);
+            _root->right(t->right());
+        }
+        else
+            _root = t->right();
+
+        return Base::remove(e);
+    }
+
+    Element *remove(const Object_Type *obj)
+    {
+        Element *e = search(obj);
+        if (e)
+            return remove(e);
+        return 0;
+    }
+
+    Element *remove_head()
+    {
+        if (empty())
+            return 0;
+        return remove(head());
+    }
+
+    // Moves e, still linked, to the position its rank (changed in place) now requires
+    void rerank(Element *e)
+    {
+        remove(e);
+        insert(e);
+    }
+
+    // The ranks of all elements were lowered by n in place, which keeps their
+    // order: the keys follow without relinking or touching the tree (O(n))
+    void shift(int n)
+    {
+        for (Element *e = head(); e; e = e->next())
+            e->key(e->key() - n, e->order());
+    }
+
+    Element *remove_tail()
+    {
+        if (empty())
+            return 0;
+        return remove(tail());
+    }
+
+private:
+    // Insertion orders are compared by their difference, so the counter may wrap
+    static bool less(const Element *a, const Element *b)
+    {
+        return (a->key() < b->key()) || ((a->key() == b->key()) && (long(a->order() - b->order()) < 0));
+    }
+
+    // Top-down splay (Sleator and Tarjan): brings k, or the last node on its search path, to the root of t
+    static Element *splay(Element *t, const Element *k)
+    {
+        Element *l = 0, *r = 0;       // trees of the nodes smaller and larger than k
+        Element *lmax = 0, *rmin = 0; // where the next ones are hooked
+        for (;;)
+        {
+            if (less(k, t))
+            {
+                Element *c = t->left();
+                if (!c)
+                    break;
+                if (less(k, c))
+                {
+                    t->left(c->right());
+                    c->right(t);
+                    t = c;
+                    if (!t->left())
+                        break;
+                }
+                if (rmin)
+                    rmin->left(t);
+                else
+                    r = t;
+                rmin = t;
+                t = t->left();
+            }
+            else if (less(t, k))
+            {
+                Element *c = t->right();
+                if (!c)
+                    break;
+                if (less(c, k))
+                {
+                    t->right(c->left());
+                    c->left(t);
+                    t = c;
+                    if (!t->right())
+                        break;
+                }
+                if (lmax)
+                    lmax->right(t);
+                else
+                    l = t;
+                lmax = t;
+                t = t->right();
+            }
+            else
+                break;
+        }
+        if (lmax)
+        {
+            lmax->right(t->left());
+            t->left(l);
+        }
+        if (rmin)
+        {
+            rmin->left(t->right());
+            t->right(r);
+        }
+        return t;
+    }
+
+private:
+    Element *_root;
+    unsigned long _order;
+};
+
 // Doubly-Linked, Typed List
 template <typename T = void,
           typename R = List_Element_Rank,
@@ -1321,6 +1637,15 @@ public:
     // Quantidade de filas ocupadas em determinado momento
     const int occupied_queues() { return _occupied_queues; }
 
+    // Proxima subfila com threads depois de queue (em ordem circular); queue se todas as outras estiverem vazias
+    unsigned int next_nonempty_queue(unsigned int queue) {
+        unsigned int q = queue;
+        do
+            q = (q + 1) % Q;
+        while (_list[q].empty() && (q != queue));
+        return q;
+    }
+
     // Se não tem _chosen -> escolhe chosen
     Element *volatile &chosen() {
         if (!_chosen) {
@@ -1497,6 +1822,29 @@ public:
         // _chosen = e;
         // return _chosen;
     }
+    // Reposiciona e, cujo rank foi alterado no lugar; queue e a subfila em
+    // que e estava antes da alteracao
+    void rerank(Element *e, unsigned int queue)
+    {
+        if (e == _chosen)
+            return;
+
+        if (e->rank().queue_eamq() == queue) {
+            _list[queue].rerank(e);
+            return;
+        }
+
+        _list[queue].remove(e);
+        if (_list[queue].empty())
+            _occupied_queues--;
+        if (_list[e->rank().queue_eamq()].empty())
+            _occupied_queues++;
+        _list[e->rank().queue_eamq()].insert(e);
+    }
+
+    // Os ranks de toda a subfila queue diminuiram de n no lugar (a ordem se mantem)
+    void shift(unsigned int queue, int n) { _list[queue].shift(n); }
+
     void chosen(Element * e) { _chosen = e; }
     void pop_chosen() { _chosen = nullptr; }
 //    Element * remove() {
@@ -1509,7 +1857,171 @@ public:
 private:
     L _list[Q];
     unsigned int _total_size;
-    unsigned int _occupied_queues; 
+    unsigned int _occupied_queues;
+    Element *volatile _chosen;
+};
+
+// Mesma semantica de Scheduling_Multilist_Single_Chosen, mas com um bitmap de
+// ocupacao das subfilas (occupied_queues() vira um popcount) e subfilas
+// indexadas por rank (Indexed_Ordered_List), de forma que insert e remove
+// custam O(log n) amortizado e a escolha da cabeca O(1).
+// Selecionada por Traits<EAMQ>::indexed_queues.
+template <typename T,
+          typename R = typename T::Criterion,
+          typename El = List_Elements::Doubly_Linked_Indexed_Scheduling<T, R>,
+          typename L = Indexed_Ordered_List<T, R, El>,
+          unsigned int Q = R::QUEUES>
+class Indexed_Scheduling_Multilist_Single_Chosen
+{
+public:
+    typedef T Object_Type;
+    typedef R Rank_Type;
+    typedef El Element;
+    typedef typename L::Iterator Iterator;
+
+public:
+    Indexed_Scheduling_Multilist_Single_Chosen() : _total_size(0), _occupied(0), _chosen(0) {}
+
+    bool empty() const { return !(_occupied & (1U << R::current_queue_eamq())); }
+    bool empty(unsigned int queue) { return !(_occupied & (1U << queue)); }
+
+    unsigned long size() const { return _list[R::current_queue_eamq()].size(); }
+    unsigned long size(unsigned int queue) const { return _list[queue].size(); }
+
+    unsigned long total_size() const { return _total_size; }
+
+    Element *head() { return _list[R::current_queue_eamq()].head(); }
+    Element *head(unsigned int i) { return _list[i].head(); }
+    Element *tail() { return _list[R::current_queue_eamq()].tail(); }
+    Element *tail(unsigned int i) { return _list[i].tail(); }
+
+    Iterator begin() { return Iterator(_list[R::current_queue_eamq()].head()); }
+    Iterator begin(unsigned int queue) { return Iterator(_list[queue].head()); }
+    Iterator end() { return Iterator(0); }
+    Iterator end(unsigned int queue) { return Iterator(_list[queue].tail()); }
+
+    // Quantidade de filas ocupadas em determinado momento
+    const int occupied_queues() { return Math::popcount(_occupied); }
+
+    // Bitmap das subfilas com threads prontas (bit q => subfila q)
+    unsigned int occupancy() const { return _occupied; }
+
+    // Proxima subfila com threads depois de queue (em ordem circular); queue se todas as outras estiverem vazias.
+    // Primeiro os bits acima de queue, depois o menor bit (que pode ser o da propria queue)
+    unsigned int next_nonempty_queue(unsigned int queue) const {
+        unsigned int above = _occupied & ~((2U << queue) - 1);
+        if (above)
+            return Math::lsb(above);
+        return _occupied ? Math::lsb(_occupied) : queue;
+    }
+
+    // Se não tem _chosen -> escolhe chosen
+    Element *volatile &chosen() {
+        if (!_chosen)
+            choose();
+        return _chosen;
+    }
+
+    void insert(Element *e)
+    {
+        // Se é primeiro a ser inserido -> chosen vai ser ele mesmo
+        if (empty(e->rank().queue_eamq()) && !_chosen)
+            _chosen = e;
+        else
+            enqueue(e);
+    }
+
+    Element *remove(Element *e)
+    {
+        if (e == _chosen) {
+            // current_queue_eamq() precisa apontar para uma fila com threads (ver EAMQ::handle(CHANGE_QUEUE))
+            _chosen = empty() ? 0 : dequeue_head(R::current_queue_eamq());
+            return e;
+        }
+
+        return dequeue(e);
+    }
+
+    Element *choose()
+    {
+        if (empty())
+            return _chosen;
+
+        if (_chosen)
+            enqueue(_chosen);
+        _chosen = dequeue_head(R::current_queue_eamq());
+
+        return _chosen;
+    }
+
+    Element *choose_another()
+    {
+        if (!empty() && head()->rank() != R::IDLE) {
+            Element *tmp = _chosen;
+            _chosen = dequeue_head(R::current_queue_eamq());
+            enqueue(tmp);
+        }
+
+        return _chosen;
+    }
+
+    Element *choose(Element *e)
+    {
+        if (e != _chosen) {
+            if (_chosen)
+                enqueue(_chosen);
+            _chosen = dequeue(e);
+        }
+
+        return _chosen;
+    }
+
+    // Reposiciona e, cujo rank foi alterado no lugar; queue e a subfila em
+    // que e estava antes da alteracao
+    void rerank(Element *e, unsigned int queue)
+    {
+        if (e == _chosen)
+            return;
+
+        if (e->rank().queue_eamq() == queue)
+            _list[queue].rerank(e);
+        else {
+            dequeue(e, queue);
+            enqueue(e);
+        }
+    }
+
+    // Os ranks de toda a subfila queue diminuiram de n no lugar (a ordem se mantem)
+    void shift(unsigned int queue, int n) { _list[queue].shift(n); }
+
+    void chosen(Element * e) { _chosen = e; }
+    void pop_chosen() { _chosen = nullptr; }
+
+private:
+    void enqueue(Element *e)
+    {
+        unsigned int q = e->rank().queue_eamq();
+        _list[q].insert(e);
+        _occupied |= 1U << q;
+        _total_size++;
+    }
+
+    Element *dequeue(Element *e) { return dequeue(e, e->rank().queue_eamq()); }
+    Element *dequeue_head(unsigned int q) { return dequeue(_list[q].head(), q); }
+
+    Element *dequeue(Element *e, unsigned int q)
+    {
+        _list[q].remove(e);
+        if (_list[q].empty())
+            _occupied &= ~(1U << q);
+        _total_size--;
+        return e;
+    }
+
+private:
+    L _list[Q];
+    unsigned int _total_size;
+    unsigned int _occupied;
     Element *volatile _chosen;
 };
 
@@ -1867,6 +2379,9 @@ public:
     unsigned long size() const { return _list[R::current_queue()].size(); }
     unsigned long size(unsigned int queue) const { return _list[queue].size(); }
 
+    // Prontos (em todas as subfilas) de um core, sem o chosen dele
+    unsigned long total_size(unsigned int queue) const { return _list[queue].total_size(); }
+
     unsigned long total_size() const
     {
         unsigned long s = 0;
@@ -1892,6 +2407,10 @@ public:
         return _list[R::current_queue()].occupied_queues();
     }
 
+    unsigned int next_nonempty_queue(unsigned int queue) {
+        return _list[R::current_queue()].next_nonempty_queue(queue);
+    }
+
     Element *volatile &chosen()
     {
         //db<Lists>(WRN) << "Pegando CHOSEN da fila" << R::current_queue() << " : " << _list[R::current_queue()].chosen() << endl;
@@ -1958,10 +2477,33 @@ public:
         return _list[e->rank().queue()].choose(e);
     }
 
+    // Reposiciona e (rank alterado no lugar) dentro do seu core; queue e a
+    // subfila EAMQ anterior a alteracao
+    void rerank(Element *e, unsigned int queue)
+    {
+        _list[e->rank().queue()].rerank(e, queue);
+    }
+
+    // Os ranks da subfila EAMQ queue deste core diminuiram de n no lugar
+    void shift(unsigned int queue, int n)
+    {
+        _list[R::current_queue()].shift(queue, n);
+    }
+
 private:
     L _list[QM];
 };
 
+// Multilist particionado usando as subfilas indexadas (ver Indexed_Scheduling_Multilist_Single_Chosen)
+template <typename T,
+          typename R = typename T::Criterion,
+          typename El = List_Elements::Doubly_Linked_Indexed_Scheduling<T, R>,
+          unsigned int Q = R::QUEUES,
+          unsigned int QM = R::QUEUES_CORES>
+class Indexed_Multilist_Scheduling_Multilist : public Multilist_Scheduling_Multilist<T, R, El, Q, QM, Indexed_Ordered_List<T, R, El>, Indexed_Scheduling_Multilist_Single_Chosen<T, R, El, Indexed_Ordered_List<T, R, El>, Q>>
+{
+};
+
 // Doubly-Linked, Grouping List
 template <typename T,
           typename El = List_Elements::Doubly_Linked_Grouping<T>>
@@ -272,6 +272,21 @@ inline T1 lcm(T1 a, T2 b)
     return temp ? a * (b / temp) : 0;
 }
 
+// Index of the least significant set bit (x must not be 0)
+inline unsigned int lsb(unsigned int x)
+{
+    return __builtin_ctz(x);
+}
+
+// Number of set bits (SWAR, so no libgcc helper is needed on CPUs without popcnt)
+inline unsigned int popcount(unsigned int x)
+{
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0f0f0f0f;
+    return (x * 0x01010101) >> 24;
+}
+
 }
 
 __END_UTIL
@@ -29,7 +29,7 @@ private:
 public:
     typedef typename T::Criterion Criterion;
     typedef Scheduling_List<T, Criterion> Queue;
-    typedef typename Queue::Element Element;
+    typedef typename Base::Element Element;
 
 public:
     Scheduler() {}
@@ -106,6 +106,21 @@ public:
 
         return obj;
     }
+
+    // obj's criterion was changed in place; queue is the EAMQ sub-queue it was in before
+    void rerank(T * obj, unsigned int queue) {
+        Base::rerank(obj->link(), queue);
+    }
+
+    // The criteria of all threads in the EAMQ sub-queue queue of this core were lowered by n in place (same order)
+    void shift(unsigned int queue, int n) {
+        Base::shift(queue, n);
+    }
+
+    // First non-empty EAMQ sub-queue after queue (round-robin), or queue itself if all others are empty
+    unsigned int next_nonempty_queue(unsigned int queue) {
+        return Base::next_nonempty_queue(queue);
+    }
 };
 
 
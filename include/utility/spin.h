@@ -33,7 +33,21 @@ public:
     	}
     }
 
+    bool try_acquire() {
+        unsigned long me = _running();
+
+        unsigned long owner = CPU::cas(_owner, 0UL, me);
+        if((owner != 0) && (owner != me))
+            return false;
+        _level++;
+
+        db<Spin>(TRC) << "Spin::try_acquire[this=" << this << ",id=" << hex << me << "]() => {owner=" << _owner << dec << ",level=" << _level << "}" << endl;
+
+        return true;
+    }
+
     volatile bool taken() const { return (_owner != 0); }
+    volatile long level() const { return _level; }
 
 private:
     volatile long _level;
@@ -8,18 +8,38 @@
 __BEGIN_SYS
 
 Alarm_Timer * Alarm::_timer;
-volatile Alarm::Tick Alarm::_elapsed;
-Alarm::Queue Alarm::_request;
+volatile Alarm::Tick Alarm::_now[CPUS];
+volatile Alarm::Tick Alarm::_armed[CPUS];
+Alarm::Queue Alarm::_wheel[CPUS][LEVELS][SLOTS];
+volatile unsigned int Alarm::_occupied[CPUS][LEVELS];
+Alarm::Near Alarm::_near[CPUS];
+Alarm::Queue Alarm::_due[CPUS];
 
-Alarm::Alarm(Microsecond time, Handler * handler, unsigned int times)
-: _time(time), _handler(handler), _times(times), _ticks(ticks(time)), _link(this, _ticks)
+Alarm::Alarm(Microsecond time, Handler * handler, unsigned int times, unsigned int cpu)
+: _time(time), _handler(handler), _times(times), _ticks(ticks(time)), _cycles(high_resolution ? cycles(time) : 0), _cpu(cpu), _batched(false), _slot(0), _link(this)
 {
-    lock();
+    assert(cpu < CPUS);
+
+    lock(_cpu);
+
+    // A period shorter than the resolution would be due again at once and keep expire() looping
+    if(times != 1) {
+        if(_ticks == 0)
+            _ticks = 1;
+        if(high_resolution && (_cycles == 0))
+            _cycles = 1;
+    }
 
-    db<Alarm>(TRC) << "Alarm(t=" << time << ",tk=" << _ticks << ",h=" << reinterpret_cast<void *>(handler) << ",x=" << times << ") => " << this << endl;
+    db<Alarm>(TRC) << "Alarm(t=" << time << ",tk=" << _ticks << ",h=" << reinterpret_cast<void *>(handler) << ",x=" << times << ",cpu=" << cpu << ") => " << this << endl;
 
-    if(_ticks) {
-        _request.insert(&_link);
+    if(high_resolution ? (_cycles != 0) : (_ticks != 0)) {
+        if(high_resolution) {
+            _link.rank(TSC::time_stamp() + _cycles);
+            _deadline = tick(_cpu, _link.rank());
+        } else
+            _deadline = _now[_cpu] + _ticks;
+        enqueue(this);
+        rearm(this);
         unlock();
     } else {
         assert(times == 1);
@@ -30,26 +50,32 @@ Alarm::Alarm(Microsecond time, Handler * handler, unsigned int times)
 
 Alarm::~Alarm()
 {
-    lock();
+    lock(_cpu);
 
     db<Alarm>(TRC) << "~Alarm(this=" << this << ")" << endl;
 
-    _request.remove(this);
+    dequeue(this);
 
     unlock();
 }
 
 void Alarm::reset()
 {
-    bool locked = Thread::locked();
+    // Callers may already hold the lock of the alarm's core (e.g. its handlers), but holding another core's is not enough
+    bool locked = Thread::locked(_cpu);
     if(!locked)
-        lock();
+        lock(_cpu);
 
     db<Alarm>(TRC) << "Alarm::reset(this=" << this << ")" << endl;
 
-    _request.remove(this);
-    _link.rank(_ticks);
-    _request.insert(&_link);
+    dequeue(this);
+    if(high_resolution) {
+        _link.rank(TSC::time_stamp() + _cycles);
+        _deadline = tick(_cpu, _link.rank());
+    } else
+        _deadline = _now[_cpu] + _ticks;
+    enqueue(this);
+    rearm(this);
 
     if(!locked)
         unlock();
@@ -57,21 +83,248 @@ void Alarm::reset()
 
 void Alarm::period(Microsecond p)
 {
-    bool locked = Thread::locked();
+    bool locked = Thread::locked(_cpu);
     if(!locked)
-        lock();
+        lock(_cpu);
 
     db<Alarm>(TRC) << "Alarm::period(this=" << this << ",p=" << p << ")" << endl;
 
-    _request.remove(this);
+    // The current period still expires as programmed, the new one applies from the next
     _time = p;
-    _ticks = ticks(p);
-    _request.insert(&_link);
+    _ticks = ticks(p) ? ticks(p) : 1; // at least one tick, or next_due() would release it again at once
+    if(high_resolution)
+        _cycles = cycles(p) ? cycles(p) : 1;
 
     if(!locked)
         unlock();
 }
 
+void Alarm::cpu(unsigned int c)
+{
+    assert(c < CPUS);
+
+    // Both wheels are touched, so all locks are taken (in order)
+    lock();
+
+    db<Alarm>(TRC) << "Alarm::cpu(this=" << this << ",cpu=" << c << ")" << endl;
+
+    if(c != _cpu) {
+        bool queued = (_slot != 0);
+        dequeue(this);
+        _deadline = high_resolution ? tick(c, _link.rank()) : _deadline - _now[_cpu] + _now[c];
+        _cpu = c;
+        if(queued) {
+            enqueue(this);
+            rearm(this);
+        }
+    }
+
+    unlock();
+}
+
+Microsecond Alarm::next()
+{
+    Tick t = pending(CPU::id());
+    if(t == Timer::FOREVER)
+        return INFINITE;
+    return t ? Timer_Common::time(t, frequency()) : Microsecond(0);
+}
+
+Alarm::Tick Alarm::next_tick()
+{
+    unsigned int cpu = CPU::id();
+    Tick t = pending(cpu);
+    _armed[cpu] = _now[cpu] + t;
+    return t;
+}
+
+void Alarm::rearm(Alarm * alarm)
+{
+    unsigned int cpu = alarm->_cpu;
+    if(!Timer::tickless || (long(alarm->_deadline - _armed[cpu]) >= 0))
+        return;
+
+    _armed[cpu] = alarm->_deadline;
+
+    // Go back to periodic ticks on the alarm's core, until it reprograms the one-shot
+    if(cpu == CPU::id())
+        Timer::periodic();
+    else
+        Thread::reschedule(cpu);
+}
+
+Alarm::Tick Alarm::tick(unsigned int cpu, const Time_Stamp & expiration)
+{
+    Time_Stamp now = TSC::time_stamp();
+    if(expiration <= now)
+        return _now[cpu];
+
+    // Somewhere inside the current tick, so it may round down by one, which only brings it to the ordered list earlier
+    return _now[cpu] + Tick((expiration - now) / (CPU::max_clock() / frequency()));
+}
+
+Alarm::Tick Alarm::pending(unsigned int cpu)
+{
+    if(!_due[cpu].empty() || (high_resolution && !_near[cpu].empty()))
+        return 0;
+
+    Tick t = _now[cpu];
+    Tick next = Timer::FOREVER;
+    for(unsigned int l = 0; l < LEVELS; l++) {
+        unsigned int occupied = _occupied[cpu][l];
+        if(!occupied)
+            continue;
+
+        // Slots are visited from the one after the current, which comes last (a whole turn ahead)
+        unsigned int shift = SLOT_BITS * l;
+        unsigned int first = ((t >> shift) + 1) & MASK;
+        unsigned int rotated = first ? (((occupied >> first) | (occupied << (SLOTS - first))) & (~0U >> (32 - SLOTS))) : occupied;
+        Tick block = ((t >> shift) + 1 + Math::lsb(rotated)) << shift;
+
+        // Level 0 slots hold exact deadlines, the others only their cascade tick
+        if(block - t < next)
+            next = block - t;
+    }
+
+    return next;
+}
+
+void Alarm::enqueue(Alarm * alarm)
+{
+    unsigned int cpu = alarm->_cpu;
+    Tick now = _now[cpu];
+    Tick delta = alarm->_deadline - now;
+
+    // In the current tick (or late): to the ordered list, which this core's timer will interrupt for
+    if(high_resolution && (long(delta) <= 0)) {
+        alarm->_slot = &_near[cpu];
+        _near[cpu].insert(&alarm->_link);
+        // From another core, it is only seen at the next tick of cpu
+        if((cpu == CPU::id()) && (_near[cpu].head() == &alarm->_link))
+            Timer::deadline(alarm->_link.rank());
+        return;
+    }
+
+    // Due in the current tick (whose level 0 slot has already been swept) or overdue (e.g. a periodic alarm whose
+    // handlers ran late, or one rebased by cpu()): it is due right away
+    if(long(delta) <= 0) {
+        alarm->_slot = &_due[cpu];
+        _due[cpu].insert(&alarm->_link);
+        return;
+    }
+
+    if(delta > HORIZON)
+        delta = HORIZON;
+
+    unsigned int l = 0;
+    while((l < LEVELS - 1) && (delta >> (SLOT_BITS * (l + 1))))
+        l++;
+
+    unsigned int s = ((now + delta) >> (SLOT_BITS * l)) & MASK;
+    alarm->_slot = &_wheel[cpu][l][s];
+    alarm->_slot->insert(&alarm->_link);
+    _occupied[cpu][l] |= 1U << s;
+}
+
+void Alarm::dequeue(Alarm * alarm)
+{
+    Queue * q = alarm->_slot;
+    if(!q)
+        return;
+
+    q->remove(&alarm->_link);
+    alarm->_slot = 0;
+
+    unsigned int cpu = alarm->_cpu;
+    if((q != &_due[cpu]) && (q != &_near[cpu]) && q->empty()) {
+        unsigned int i = q - &_wheel[cpu][0][0];
+        _occupied[cpu][i / SLOTS] &= ~(1U << (i % SLOTS));
+    }
+}
+
+void Alarm::cascade(unsigned int cpu, unsigned int level, unsigned int slot)
+{
+    Queue * q = &_wheel[cpu][level][slot];
+    _occupied[cpu][level] &= ~(1U << slot);
+
+    // Everything in this slot expires within its block, which starts now, so it lands on lower levels (or back on top, beyond HORIZON)
+    for(Queue::Element * e = q->remove(); e; e = q->remove())
+        enqueue(e->object());
+}
+
+void Alarm::release(unsigned int cpu)
+{
+    Time_Stamp now = TSC::time_stamp();
+    while(!_near[cpu].empty() && (_near[cpu].head()->rank() <= now)) {
+        Queue::Element * e = _near[cpu].remove();
+        e->object()->_slot = &_due[cpu];
+        _due[cpu].insert(e);
+    }
+
+    Timer::deadline(_near[cpu].empty() ? 0 : _near[cpu].head()->rank());
+}
+
+Alarm * Alarm::next_due(unsigned int cpu)
+{
+    Queue::Element * e = _due[cpu].remove();
+    if(!e)
+        return 0;
+
+    Alarm * alarm = e->object();
+    alarm->_slot = 0;
+    if(alarm->_times != INFINITE)
+        alarm->_times--;
+    if(alarm->_times > 0) {
+        // From the previous deadline, so periodic releases do not drift by the latency of the handlers
+        if(high_resolution) {
+            alarm->_link.rank(alarm->_link.rank() + alarm->_cycles);
+            alarm->_deadline = tick(cpu, alarm->_link.rank());
+        } else
+            alarm->_deadline += alarm->_ticks;
+        enqueue(alarm);
+    }
+
+    return alarm;
+}
+
+void Alarm::expire(unsigned int cpu)
+{
+    // Handlers are called one at a time outside the lock; whatever gets destroyed meanwhile leaves _due in its destructor
+    for(;;) {
+        lock(cpu);
+
+        Queue::Element * e = _due[cpu].head();
+        if(!e) {
+            unlock();
+            break;
+        }
+
+        // Job releases only wake threads up, so a run of them is handled under this core's lock (the only scheduler
+        // lock Semaphore::v() takes, to insert the threads partitioned here), and each core concerned is rescheduled
+        // once at the end
+        if(e->object()->_batched) {
+            Thread::batch(true);
+            unsigned int n = 0;
+            for(e = _due[cpu].head(); e && e->object()->_batched; e = _due[cpu].head(), n++) {
+                Alarm * alarm = next_due(cpu);
+                (*alarm->_handler)();
+            }
+            db<Alarm>(TRC) << "Alarm::handler(cpu=" << cpu << ",e=" << _now[cpu] << ",batch=" << n << ")" << endl;
+            Thread::batch(false);
+            unlock();
+            continue;
+        }
+
+        Alarm * alarm = next_due(cpu);
+        Handler * handler = alarm->_handler;
+
+        unlock();
+
+        db<Alarm>(TRC) << "Alarm::handler(this=" << alarm << ",cpu=" << cpu << ",e=" << _now[cpu] << ",h=" << reinterpret_cast<void*>(handler) << ")" << endl;
+        (*handler)();
+    }
+}
+
 
 void Alarm::delay(Microsecond time)
 {
@@ -86,42 +339,63 @@ void Alarm::delay(Microsecond time)
 
 void Alarm::handler(IC::Interrupt_Id i)
 {
-    lock();
+    unsigned int cpu = CPU::id();
+
+    lock(cpu);
 
-    _elapsed++;
+    Tick t = ++_now[cpu];
 
-    if(Traits<Alarm>::visible) {
+    if(Traits<Alarm>::visible && (cpu == CPU::BSP)) {
         Display display;
         int lin, col;
         display.position(&lin, &col);
         display.position(0, 79);
-        display.putc(_elapsed);
+        display.putc(t);
         display.position(lin, col);
     }
 
-    Alarm * alarm = 0;
-
-    if(!_request.empty()) {
-        // Replacing the following "if" by a "while" loop is tempting, but recovering the lock and dispatching the handler is
-        // troublesome if the Alarm gets destroyed in between, like is the case for the idle thread returning to shutdown the machine
-        if(_request.head()->promote() <= 0) { // rank can be negative whenever multiple handlers get created for the same time tick
-            Queue::Element * e = _request.remove();
-            alarm = e->object();
-            if(alarm->_times != INFINITE)
-                alarm->_times--;
-            if(alarm->_times > 0) {
-                e->rank(alarm->_ticks);
-                _request.insert(e);
+    // Each level cascades into the lower ones when the one below it wraps around
+    for(unsigned int l = 1; (l < LEVELS) && !((t >> (SLOT_BITS * (l - 1))) & MASK); l++)
+        cascade(cpu, l, (t >> (SLOT_BITS * l)) & MASK);
+
+    // All alarms due in this tick are released together (in insertion order), instead of one per tick
+    // (in high resolution, they are sorted by expiration and released each at its own time)
+    unsigned int s = t & MASK;
+    if(_occupied[cpu][0] & (1U << s)) {
+        _occupied[cpu][0] &= ~(1U << s);
+        Queue * q = &_wheel[cpu][0][s];
+        for(Queue::Element * e = q->remove(); e; e = q->remove()) {
+            if(high_resolution) {
+                e->object()->_slot = &_near[cpu];
+                _near[cpu].insert(e);
+            } else {
+                e->object()->_slot = &_due[cpu];
+                _due[cpu].insert(e);
             }
         }
     }
+    if(high_resolution)
+        release(cpu);
+
+    bool due = !_due[cpu].empty();
 
     unlock();
 
-    if(alarm) {
-        db<Alarm>(TRC) << "Alarm::handler(this=" << alarm << ",e=" << _elapsed << ",h=" << reinterpret_cast<void*>(alarm->handler) << ")" << endl;
-        (*alarm->_handler)();
-    }
+    if(due)
+        expire(cpu);
+}
+
+void Alarm::precise(IC::Interrupt_Id i)
+{
+    unsigned int cpu = CPU::id();
+
+    lock(cpu);
+    release(cpu);
+    bool due = !_due[cpu].empty();
+    unlock();
+
+    if(due)
+        expire(cpu);
 }
 
 __END_SYS
@@ -10,6 +10,8 @@ void Alarm::init()
     db<Init, Alarm>(TRC) << "Alarm::init()" << endl;
 
     _timer = new (SYSTEM) Alarm_Timer(handler);
+    if(high_resolution)
+        Timer::precise(precise);
 }
 
 __END_SYS
@@ -0,0 +1,79 @@
+// EPOS DVFS Governor Implementation
+
+#include <dvfs.h>
+#include <energy.h>
+
+__BEGIN_SYS
+
+unsigned int DVFS_Governor::_applied[Traits<Machine>::CPUS];
+unsigned int DVFS_Governor::_pending[Traits<Machine>::CPUS];
+unsigned int DVFS_Governor::_streak[Traits<Machine>::CPUS];
+DVFS_Governor::Count DVFS_Governor::_base[Traits<Machine>::CPUS];
+DVFS_Governor::Count DVFS_Governor::_carry[Traits<Machine>::CPUS];
+
+// Cada core comeca na frequencia maxima (CPU::init nao modula o clock)
+void DVFS_Governor::init()
+{
+    unsigned int cpu = CPU::id();
+    _applied[cpu] = FULL;
+    _pending[cpu] = FULL;
+    _streak[cpu] = 0;
+    _base[cpu] = 0;
+    _carry[cpu] = 0;
+}
+
+void DVFS_Governor::request(unsigned int share)
+{
+    if(!enabled)
+        return;
+
+    unsigned int cpu = CPU::id();
+    if(share == _applied[cpu]) {
+        _streak[cpu] = 0;
+        return;
+    }
+
+    if(share > _applied[cpu]) {
+        apply(share);
+        return;
+    }
+
+    // Mais lento: espera HYSTERESIS pedidos seguidos e entao vai para o mais rapido deles
+    if(!_streak[cpu] || (share > _pending[cpu]))
+        _pending[cpu] = share;
+    if(++_streak[cpu] >= HYSTERESIS)
+        apply(_pending[cpu]);
+}
+
+void DVFS_Governor::apply(unsigned int share)
+{
+    unsigned int cpu = CPU::id();
+
+    // Fecha o trecho medido no operating point anterior
+    Energy_Meter::account();
+    Count now = PMU::read(0);
+    _carry[cpu] += scale(now - _base[cpu], _applied[cpu]);
+    _base[cpu] = now;
+
+    _applied[cpu] = share;
+    _streak[cpu] = 0;
+    CPU::clock(CPU::max_clock() / FULL * share);
+
+    db<EAMQ>(TRC) << "DVFS_Governor::apply(cpu=" << cpu << ",share=" << share << ") => " << CPU::clock() / 1000000 << "MHz" << endl;
+}
+
+DVFS_Governor::Count DVFS_Governor::cycles()
+{
+    unsigned int cpu = CPU::id();
+    return _carry[cpu] + scale(PMU::read(0) - _base[cpu], _applied[cpu]);
+}
+
+void DVFS_Governor::restart()
+{
+    unsigned int cpu = CPU::id();
+    PMU::reset(0);
+    _base[cpu] = 0;
+    _carry[cpu] = 0;
+}
+
+__END_SYS
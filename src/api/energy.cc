@@ -0,0 +1,51 @@
+// EPOS Energy Meter Implementation
+
+#include <energy.h>
+#include <dvfs.h>
+
+__BEGIN_SYS
+
+TSC::Time_Stamp Energy_Meter::_stamp[Traits<Machine>::CPUS];
+bool Energy_Meter::_halted[Traits<Machine>::CPUS];
+Energy_Meter::Energy Energy_Meter::_total[Traits<Machine>::CPUS];
+Energy_Meter::Energy Energy_Meter::_unclaimed[Traits<Machine>::CPUS];
+constexpr unsigned int Traits<CPU>::POWER[];
+
+void Energy_Meter::init()
+{
+    unsigned int cpu = CPU::id();
+    _stamp[cpu] = TSC::time_stamp();
+    _halted[cpu] = false;
+    _total[cpu] = 0;
+    _unclaimed[cpu] = 0;
+}
+
+unsigned int Energy_Meter::power()
+{
+    return _halted[CPU::id()] ? halt_power() : power(DVFS_Governor::share());
+}
+
+void Energy_Meter::account()
+{
+    if(!enabled)
+        return;
+
+    unsigned int cpu = CPU::id();
+    TSC::Time_Stamp now = TSC::time_stamp();
+    Energy e = Energy(now - _stamp[cpu]) * power();
+    _stamp[cpu] = now;
+    _total[cpu] += e;
+    _unclaimed[cpu] += e;
+}
+
+Energy_Meter::Energy Energy_Meter::claim()
+{
+    account();
+
+    unsigned int cpu = CPU::id();
+    Energy e = _unclaimed[cpu];
+    _unclaimed[cpu] = 0;
+    return e;
+}
+
+__END_SYS
@@ -0,0 +1,51 @@
+// EPOS Idle State Manager Implementation
+
+#include <idle.h>
+#include <dvfs.h>
+#include <energy.h>
+
+__BEGIN_SYS
+
+bool Idle_Manager::_mwait;
+volatile unsigned int Idle_Manager::_listening[Traits<Machine>::CPUS];
+
+void Idle_Manager::init()
+{
+    if(CPU::id() == CPU::BSP)
+        _mwait = CPU::has_mwait();
+    _listening[CPU::id()] = false;
+}
+
+Idle_Manager::State Idle_Manager::choose(Microsecond predicted)
+{
+    if(DVFS_Governor::enabled && (Time_Base(predicted) >= Traits<CPU>::SLOW_IDLE))
+        return SLOW;
+    return _mwait ? MWAIT : HALT;
+}
+
+void Idle_Manager::sleep(Microsecond predicted, volatile bool & wakeup)
+{
+    unsigned int cpu = CPU::id();
+    State state = choose(predicted);
+    unsigned int share = (state == SLOW) ? DVFS_Governor::park() : 0;
+
+    Energy_Meter::halt();
+    if(_mwait) {
+        CPU::int_disable();
+        CPU::tsl(_listening[cpu]); // publishes listening before wakeup is checked (see Thread::reschedule(cpu))
+        CPU::monitor(&wakeup);
+        if(!wakeup)
+            CPU::mwait();
+        CPU::cas(_listening[cpu], 1U, 0U);
+        CPU::int_enable();
+    } else {
+        CPU::int_enable();
+        CPU::halt();
+    }
+    Energy_Meter::wake();
+
+    if(state == SLOW)
+        DVFS_Governor::unpark(share);
+}
+
+__END_SYS
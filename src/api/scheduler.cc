@@ -3,6 +3,8 @@
 
 #include <process.h>
 #include <time.h>
+#include <idle.h>
+#include <architecture/profiler.h>
 #include <utility/random.h>
 #include "scheduler.h"
 
@@ -94,9 +96,27 @@ volatile unsigned int EAMQ::_current_queue[Traits<Machine>::CPUS] = {QUEUES - 1}
 // volatile unsigned int GEAMQ::_current_queue[GEAMQ::HEADS] = {QUEUES - 1}; // apenas inicializa o core 0
 // bool GEAMQ::initialized = false; // workaround para fazer uma lazy initialization no _current_queue
 bool EAMQ::initialized = false;
+volatile unsigned long EAMQ::_quanta[Traits<Machine>::CPUS][EAMQ::QUEUES];
+EAMQ::Stretch EAMQ::_stretch = EAMQ::ADAPTIVE;
+Hertz EAMQ::_frequency[EAMQ::QUEUES];
+unsigned long EAMQ::_scale[EAMQ::QUEUES][EAMQ::QUEUES];
+
+// Chamado por todos os cores em Thread::init(), mas as tabelas sao globais
+void EAMQ::init()
+{
+    if(CPU::id() != CPU::BSP)
+        return;
+
+    for(unsigned int q = 0; q < QUEUES; q++)
+        _frequency[q] = CPU::max_clock() - (CPU::max_clock() / 10000) * (10000 - share(q));
+
+    for(unsigned int from = 0; from < QUEUES; from++)
+        for(unsigned int to = 0; to < QUEUES; to++)
+            _scale[from][to] = (static_cast<unsigned long long>(_frequency[from]) << SCALE_SHIFT) / _frequency[to];
+}
 
 // Construtor para threads aperiódicas
-EAMQ::EAMQ(int p) : RT_Common(p), _is_recent_insertion(false), _personal_statistics{}, _behind_of(nullptr), _periodic(false)
+EAMQ::EAMQ(int p) : RT_Common(p), _is_recent_insertion(false), _recent_epoch(0), _personal_statistics{}, _behind_of(nullptr), _race(false), _periodic(false), _accruing(false), _epoch(0), _memory_bound(0)
 {
     EAMQ::initialize_current_queue();
 //    if (Traits<System>::RUN_TO_HALT) {
@@ -112,13 +132,13 @@ EAMQ::EAMQ(int p) : RT_Common(p), _is_recent_insertion(false), _personal_statist
         _queue_eamq = QUEUES - 1;
     } else {
         // Se a prioridade é NORMAL ou HIGH (p < LOW)
-        _queue_eamq = QUEUES - 2;
+        _queue_eamq = (QUEUES > 1) ? QUEUES - 2 : 0;
     }
     
 }
 
 // PERIODIC passado para RT_Common pois logo em seguida ele é atualizado
-EAMQ::EAMQ(Microsecond p, Microsecond d, Microsecond c) : RT_Common(PERIODIC, p, d, c), _is_recent_insertion(false), _personal_statistics{}, _behind_of(nullptr), _periodic(true)
+EAMQ::EAMQ(Microsecond p, Microsecond d, Microsecond c) : RT_Common(PERIODIC, p, d, c), _is_recent_insertion(false), _recent_epoch(0), _personal_statistics{}, _behind_of(nullptr), _race(false), _periodic(true), _accruing(false), _epoch(0), _memory_bound(0)
 {
 
     db<PEAMQ>(WRN) << "ranking with p: " << p << endl;
@@ -131,7 +151,7 @@ EAMQ::EAMQ(Microsecond p, Microsecond d, Microsecond c) : RT_Common(PERIODIC, p,
     for (unsigned int q = 0; q < QUEUES; q++)
     {
         // initial ET estimation (1/3 of deadline)
-        _personal_statistics.average_et[q] = Timer_Common::sim(c ? c : Microsecond(d / 10), CPU::max_clock(), frequency_within(q));
+        _personal_statistics.average_et[q] = scale(c ? c : Microsecond(d / 10), 0, q);
         _personal_statistics.job_estimated_et[q] = _personal_statistics.average_et[q];
         // Atualiza tempo de execução restante para EET
         _personal_statistics.remaining_et[q] = _personal_statistics.job_estimated_et[q];
@@ -146,18 +166,14 @@ void EAMQ::handle(Event event) {
     // o ponteiro da fila de escolha 
     if (event & CHANGE_QUEUE) {
         unsigned int last = current_queue_eamq();
-        do {
-            EAMQ::next_queue();
-            db<PEAMQ>(WRN) << "current_queue_eamq: " << current_queue_eamq() << endl;
-        // Enquanto fila atual não vazia ou uma volta completa
-        } while (Thread::scheduler()->empty() && (current_queue_eamq() != last));
+        // Proxima fila nao vazia (ou uma volta completa) direto do bitmap de ocupacao das subfilas
+        _current_queue[CPU::id()] = Thread::scheduler()->next_nonempty_queue(last);
         db<PEAMQ>(WRN) << "CPU " << CPU::id() << " prox: " << current_queue_eamq() << endl;
 
-        // Ajustando a frequência conforme a fila
+        // Ajustando a frequência conforme a fila (o governor so escreve o MSR em transicoes reais e
+        // reescala o canal 0 da PMU, que antes impedia o uso do CPU::clock() aqui)
         Hertz f = frequency_within(current_queue_eamq());
-
-        // P6: Nao ajustavel com o uso da PMU
-        // CPU::clock(f);
+        DVFS_Governor::request(share(current_queue_eamq()));
 
         // So that IDLE doesnt spam this
         if (last != current_queue_eamq()) {
@@ -170,51 +186,38 @@ void EAMQ::handle(Event event) {
         // P6 : inicializa estatisticas do PMU
         reset_pmu_personal_stats();
     }
-    if (event & UPDATE) {
-        db<PEAMQ>(WRN) << "UPDATE" <<endl;
-        // Depois da proxima ser definida e avisada de sua entrada, podemos desproteger as recem entradas
-        // Todas as threads recebem um evento UPDATE
-        _is_recent_insertion = false;
-        _behind_of = nullptr;
-    }
-    // Quando acontece prempcao do quantum
-    if (periodic() && (event & UPDATE)) {
-        if (Q > Time_Base(_personal_statistics.remaining_deadline)) {
-            // underflow
-            _personal_statistics.remaining_deadline = Microsecond(0);
-            // somehow discard this thread
-        } else {
-            // Decrementa do deadline o quantum executado
-            _personal_statistics.remaining_deadline -= Microsecond(Q);
-        }
+    // UPDATE nao e mais enviado a cada thread (ver elapse()): o decremento de remaining_deadline por quantum
+    // esperado e calculado sob demanda, a protecao das recem inseridas expira com a geracao da subfila e
+    // _behind_of e consumido por quem o usa (CREATE e RESUME_THREAD)
+    if (event & CREATE) {
+        // Passa a contar os quanta de espera na fila de prontos
+        rebase();
     }
     if (periodic() && (event & CREATE)) {
         db<PEAMQ>(WRN) << "CRIANDO PERIODICO" <<endl;
         // Se foi inserido no meio da fila (ou seja, se tem t_fitted)
-        if (_behind_of) {
+        if (Thread * behind_of = _behind_of) {
+            _behind_of = nullptr;
             // Faz atualização de rank da thread que foi inserida chamando assure_behind
-            _behind_of->link()->prev()->object()->for_all_behind(ASSURE_BEHIND);
+            behind_of->link()->prev()->object()->for_all_behind(ASSURE_BEHIND);
         }
     }
+    if (event & LEAVE) {
+        // Volta para a fila de prontos (ou vai esperar, e RESUME_THREAD recomeca a contagem)
+        rebase();
+    }
     if (periodic() && (event & LEAVE)) {
         db<PEAMQ>(WRN) << "LEAVE PERIODICO" <<endl;
 
         // Guarda o tempo que passou depois que começou a execução da tarefa
-        Microsecond in_cpu = time(PMU::read(0));
-
-        // Coletando dados de PMU 
-        _personal_statistics.instructions += PMU::read(2);
-        _personal_statistics.branch_miss += PMU::read(3);
-        _personal_statistics.branches += PMU::read(4);
-        _personal_statistics.cache_hit += PMU::read(5);
-        _personal_statistics.cache_miss += PMU::read(6);
+        Microsecond in_cpu = time(DVFS_Governor::cycles());
 
         _personal_statistics.job_execution_time += in_cpu;
 
         for (unsigned int q = 0; q < QUEUES; q++)
         {
             // Reduz o tempo executado deste quantum, transformando Tick em Microsecond
-            Microsecond executed_in_profile = Timer_Common::sim(in_cpu, frequency_within(_queue_eamq), frequency_within(q));
+            Microsecond executed_in_profile = scale(in_cpu, _queue_eamq, q, _memory_bound);
             if (executed_in_profile > _personal_statistics.remaining_et[q]) {
                 // underflow
                 _personal_statistics.remaining_et[q] = 0;
@@ -224,37 +227,45 @@ void EAMQ::handle(Event event) {
         }
     }
     // Quando uma thread periodica começa a tarefa
+    if (event & ENTER) {
+        // Sai da fila de prontos: consolida os quanta esperados
+        fold();
+        _accruing = false;
+    }
     if (periodic() && (event & ENTER)) {
         db<PEAMQ>(WRN) << "ENTER PERIODICO" <<endl;
-        PMU::reset(0);
-        PMU::start(0);
+        DVFS_Governor::restart();
     }
     // Quando uma thread foi liberado para executar tarefa
     if (periodic() && (event & JOB_RELEASE)) {
         db<PEAMQ>(WRN) << "RELEASE PERIODICO" <<endl;
         _personal_statistics.remaining_deadline = _deadline;
+        db<EAMQ>(TRC) << "last job energy: " << Energy_Meter::microjoules(_personal_statistics.job_energy) << " uJ" << endl;
+        _personal_statistics.job_energy = 0;
+        _epoch = now();
         _personal_statistics.job_execution_time = 0;
+        _race = race_to_idle();
         rank_eamq();
     }
     // Quando uma thread periodica termina tarefa
     if (periodic() && (event & JOB_FINISH)) {
         db<PEAMQ>(WRN) << "FINISH PERIODICO" <<endl;
-        for (auto it = Thread::scheduler()->begin(); it != Thread::scheduler()->end(); ++it) {
-            unsigned new_rank = it->rank() - (_personal_statistics.average_et[it->object()->criterion().current_queue_eamq()] + Thread::scheduler()->chosen()->priority());
-            it->rank(new_rank);
-        }
-        if ( Thread::scheduler()->end()) {
-            unsigned new_rank = Thread::scheduler()->end()->rank() + (_personal_statistics.average_et[Thread::scheduler()->end(current_queue_eamq())->object()->criterion().current_queue_eamq()] + Thread::scheduler()->chosen()->priority());
-            Thread::scheduler()->end()->rank(new_rank);
-        }
-
-        
+        // Todas as threads da fila atual andam a mesma distancia para frente, entao a ordem se mantem:
+        // os ranks mudam no lugar e a fila so ajusta o seu indice (ver shift()), sem religar ninguem.
+        // Com o lock da fila (ver Periodic_Thread::wait_next())
+        int shift = _personal_statistics.average_et[current_queue_eamq()] + Thread::scheduler()->chosen()->priority();
+        for (auto it = Thread::scheduler()->begin(); it != Thread::scheduler()->end(); ++it)
+            it->object()->criterion()._priority -= shift;
+        Thread::scheduler()->shift(current_queue_eamq(), shift);
+
+        // Quanto do job nao escala com a frequencia (ver scale())
+        _memory_bound = memory_bound();
         for (unsigned int q = 0; q < QUEUES; q++)
         {
             // (tempo de execução anterior + tempo de execução atual) / 2
             _personal_statistics.average_et[q] = (_personal_statistics.average_et[q] + _personal_statistics.job_execution_time) / 2;
             // Atualiza EET da tarefa para cada fila (relativo a frequência)
-            _personal_statistics.job_estimated_et[q] = Timer_Common::sim(_personal_statistics.average_et[q], frequency_within(_queue_eamq), frequency_within(q));
+            _personal_statistics.job_estimated_et[q] = scale(_personal_statistics.average_et[q], _queue_eamq, q, _memory_bound);
             // Timer_Common::time(_personal_statistics.average_et[q], frequency_within(q));
         }
         _personal_statistics.job_execution_time = 0;
@@ -262,33 +273,21 @@ void EAMQ::handle(Event event) {
     if (periodic() && (event & ASSURE_BEHIND)) {
         db<EAMQ>(TRC) << "p: " << _priority << " visited for rerank (someone in front was inserted)" << endl;
     }
+    if (event & RESUME_THREAD) {
+        // O tempo suspenso/esperando nao conta como quanta de espera na fila
+        rebase();
+    }
     if (periodic() && (event & RESUME_THREAD)) {
         rank_eamq(); // atualiza o rank
-        if (_behind_of) {
+        if (Thread * behind_of = _behind_of) {
+            _behind_of = nullptr;
             // Faz atualização de rank da thread que foi inserida chamando assure_behind
-            _behind_of->link()->prev()->object()->for_all_behind(ASSURE_BEHIND);
+            behind_of->link()->prev()->object()->for_all_behind(ASSURE_BEHIND);
         }
     }
     if (event & LEAVE) {
-        // P6 : coleta de dados do PMU
-        // _personal_statistics.branch_miss += PMU::read(3);
-        // _personal_statistics.cache_miss += PMU::read(4);
-        // P6 : resetar PMU
-        PMU::reset(0);
-        // PMU::reset(1);   Não estamos utilizando o canal 1 (UNHALTED_CORE_CYCLES)
-        PMU::reset(2);
-        PMU::reset(3);
-        PMU::reset(4);
-        PMU::reset(5);
-        PMU::reset(6);
-        // P6 : start PMU
-        PMU::start(0);
-        // PMU::start(1);
-        PMU::start(2);
-        PMU::start(3);
-        PMU::start(4);
-        PMU::start(5);
-        PMU::start(6);
+        // Os contadores da thread (canais 2 a 6) sao salvos por Thread::dispatch() (ver account()); o canal 0 e do core
+        DVFS_Governor::restart();
     }
 
     /* a = new Job()        -> JOB_RELEASE, CREATE
@@ -302,6 +301,10 @@ Thread * EAMQ::search_t_fitted(unsigned int q)
 {
     for (auto it = Thread::scheduler()->end(q); it != Thread::scheduler()->begin(q) && !it->object()->criterion().is_recent_insertion(); it = it->prev()) {
         Thread * thread_in_queue = it->object();
+        // Durante um rerank (Thread::for_all_behind) a propria thread continua na fila
+        if (&thread_in_queue->criterion() == this)
+            continue;
+
         // As ultimas threads da fila tendem a ser aperiodicas, então nós não queremos recalcular o rank delas
         if (!thread_in_queue->criterion().periodic()) { 
             //db<EAMQ>(TRC) << "Pulando uma thread aperiodica" << endl;
@@ -316,7 +319,7 @@ Thread * EAMQ::search_t_fitted(unsigned int q)
                                     + _personal_statistics.remaining_et[q]      // tempo de execução (Ti)
                                     + estimate_rp_waiting_time(q);              // tempo de espera por RP (Ti)
 
-        if (total_time_execution < int(Time_Base(_personal_statistics.remaining_deadline))) {
+        if (total_time_execution < int(Time_Base(remaining_deadline()))) {
             return thread_in_queue;
             // vai inserir na frente de alguem, entao salvar onde
         }
@@ -324,9 +327,46 @@ Thread * EAMQ::search_t_fitted(unsigned int q)
     return nullptr;
 }
 
+// Energia (mW x us) para executar et dentro de window e dormir no resto
+static unsigned long long stretched(unsigned int power, Microsecond et, Microsecond window)
+{
+    return static_cast<unsigned long long>(power) * Time_Base(et) + static_cast<unsigned long long>(Energy_Meter::halt_power()) * Time_Base(window - et);
+}
+
+bool EAMQ::race_to_idle() {
+    if (_stretch != ADAPTIVE)
+        return _stretch == RACE;
+
+    // Com outras threads prontas no core ele nao vai dormir, entao correr nao economiza nada
+    if (Thread::scheduler()->occupied_queues())
+        return false;
+
+    Microsecond window = _personal_statistics.remaining_deadline;
+    Microsecond et = _personal_statistics.remaining_et[0];
+    if (et >= window)
+        return true; // sem slack: rank_eamq() vai para a subfila 0 de qualquer forma
+
+    // Race: frequencia maxima, acordar do halt custa HALT_LATENCY em potencia ativa
+    unsigned long long race;
+    Microsecond slack = window - et;
+    if (Time_Base(slack) > Traits<CPU>::HALT_LATENCY)
+        race = stretched(Energy_Meter::power(share(0)), et + Microsecond(Traits<CPU>::HALT_LATENCY), window);
+    else
+        race = static_cast<unsigned long long>(Energy_Meter::power(share(0))) * Time_Base(window);
+
+    // Stretch: alguma subfila mais lenta em que o job ainda cabe gastando menos que o race
+    for (unsigned int q = 1; q < QUEUES; q++) {
+        et = _personal_statistics.remaining_et[q];
+        if ((et <= window) && (stretched(Energy_Meter::power(share(q)), et, window) < race))
+            return false;
+    }
+
+    return true;
+}
+
 int EAMQ::rank_eamq() {
-    // Baseado em Choosen não saindo da fila
-    for (unsigned int i = QUEUES - 1; i >= 0; i--) {
+    // Baseado em Choosen não saindo da fila (em race-to-idle so a subfila 0 e considerada)
+    for (unsigned int i = _race ? 1 : QUEUES; i-- > 0;) {
         // tempo de execução restante estimado
         int eet_remaining = _personal_statistics.remaining_et[i];
         
@@ -360,7 +400,7 @@ int EAMQ::rank_eamq() {
         }
 
         int cwt_profile = rp_waiting_time + (t_fitted ? t_fitted->priority() + t_fitted_capacity_remaining : 0);
-        int available_time_to_run = _personal_statistics.remaining_deadline - cwt_profile;
+        int available_time_to_run = remaining_deadline() - cwt_profile;
         int idle_time = available_time_to_run - eet_remaining;
         db<EAMQ>(TRC) << "CWT: " << cwt_profile << ", Time to run: " << available_time_to_run << ", IDLE time: " << idle_time << endl;
 
@@ -394,6 +434,59 @@ int EAMQ::rank_eamq() {
     return 0;
 }
 
+// Admissao incremental: a thread continua logo atras de ahead na sua subfila se ainda couber la.
+// O tempo de espera e a soma acumulada (prioridade de ahead + o que resta de ahead executar), entao
+// basta a thread da frente para recalcular, em O(1), o que rank_eamq() calcularia para essa posicao
+bool EAMQ::assure_behind(Thread * ahead) {
+    unsigned int q = _queue_eamq;
+
+    int cwt_profile = estimate_rp_waiting_time(q);
+    if (ahead && ahead->criterion().periodic())
+        cwt_profile += ahead->priority() + ahead->criterion().personal_statistics().remaining_et[q];
+
+    int idle_time = int(remaining_deadline()) - cwt_profile - int(_personal_statistics.remaining_et[q]);
+    if (idle_time < 0)
+        return false;
+
+    _priority = cwt_profile;
+    return true;
+}
+
+Microsecond EAMQ::remaining_deadline() {
+    if (!_accruing)
+        return _personal_statistics.remaining_deadline;
+
+    // Um quantum a menos por quantum esperado na subfila
+    unsigned long elapsed = (now() - _epoch) * Q;
+    if (elapsed > Time_Base(_personal_statistics.remaining_deadline))
+        return Microsecond(0);
+    return _personal_statistics.remaining_deadline - Microsecond(elapsed);
+}
+
+void EAMQ::fold() {
+    if (periodic())
+        _personal_statistics.remaining_deadline = remaining_deadline();
+    _epoch = now();
+}
+
+void EAMQ::set_queue(unsigned int q) {
+    bool recent = unbind();
+    _queue_eamq = q;
+    bind(recent);
+}
+
+// P6 : coleta de dados do PMU, agora por thread (PMU::Context), sem reset/start dos canais a cada troca
+void EAMQ::account(const PMU::Context & pmu) {
+    if (!periodic())
+        return;
+
+    _personal_statistics.instructions += pmu.last(PMU_INSTRUCTIONS);
+    _personal_statistics.branch_miss += pmu.last(PMU_BRANCH_MISS);
+    _personal_statistics.branches += pmu.last(PMU_BRANCHES);
+    _personal_statistics.cache_hit += pmu.last(PMU_CACHE_HIT);
+    _personal_statistics.cache_miss += pmu.last(PMU_CACHE_MISS);
+}
+
 void EAMQ::reset_pmu_personal_stats() {
     _personal_statistics.branch_miss = 0;
     _personal_statistics.cache_miss = 0;
@@ -403,6 +496,15 @@ void EAMQ::reset_pmu_personal_stats() {
     _personal_statistics.migrate = false;
 }
 
+unsigned long EAMQ::memory_bound() const {
+    if ((Traits<EAMQ>::miss_penalty == 0) || (_personal_statistics.cache_miss <= 0) || (_personal_statistics.instructions < 0))
+        return 0;
+
+    unsigned long long stall = static_cast<unsigned long long>(_personal_statistics.cache_miss) * Traits<EAMQ>::miss_penalty;
+    unsigned long long cycles = static_cast<unsigned long long>(_personal_statistics.instructions) + stall;
+    return static_cast<unsigned long>((stall << SCALE_SHIFT) / cycles);
+}
+
 int EAMQ::estimate_rp_waiting_time(unsigned int q) {
     int rp_rounds = _personal_statistics.remaining_et[q] / Q;
 
@@ -424,107 +526,183 @@ PEAMQ::Core_Statistics PEAMQ::_core_statistics = {
     /* cache_misses */        {0},
     /* instruction_retired */ {0},
     /* cache_hit */           {0},
-    /* branch_instruction */  {0}
+    /* branch_instruction */  {0},
+    /* energy */              {0}
 };
 
-volatile unsigned int PEAMQ::evaluate(bool max_core)
+volatile unsigned long PEAMQ::_demand[PEAMQ::QUEUES_CORES];
+volatile unsigned long PEAMQ::_samples[PEAMQ::QUEUES_CORES];
+volatile unsigned long PEAMQ::_balance_quanta;
+PEAMQ::Window PEAMQ::_window[PEAMQ::QUEUES_CORES];
+
+// Quanto um contador cumulativo andou desde o ultimo balance() (FINISH desconta os da thread que terminou, entao ele pode voltar)
+static unsigned long long advanced(unsigned long long now, unsigned long long & seen)
 {
-    unsigned long long min = IDLE;
-    unsigned int chosen_core = 0;
-    unsigned long long max = 0;
-    unsigned int max_core_id = 0;
+    unsigned long long delta = (now > seen) ? now - seen : 0;
+    seen = now;
+    return delta;
+}
+
+// Media movel com decaimento exponencial (peso 1/2^balance_decay para a amostra nova)
+static unsigned long decayed(unsigned long average, unsigned long sample)
+{
+    return average - (average >> Traits<EAMQ>::balance_decay) + (sample >> Traits<EAMQ>::balance_decay);
+}
 
-    // avaliacao com dados da PMU que setam "pontos iniciais" para cada core
+// A cada quantum (Thread::time_slicer()), cada core soma quantas threads tem executaveis (a que roda e as prontas,
+// que total_size() ja conta: com a idle rodando, ela e a unica fora da fila). Retorna true para o core que fecha
+// um periodo do balanceador (balance_period quanta de todos os cores)
+bool PEAMQ::sample()
+{
+    unsigned int core = CPU::id();
+    _demand[core] += Thread::scheduler()->total_size(core);
+    _samples[core]++;
+    const unsigned int period = Traits<EAMQ>::balance_period ? Traits<EAMQ>::balance_period : 1; // (balanced is false otherwise)
+    return !((CPU::finc(_balance_quanta) + 1) % (period * CPU::cores()));
+}
+
+// Balanceador periodico (com Thread::lock(), ver Thread::balance()): atualiza a carga e a pressao da PMU de cada core
+// com o que aconteceu na janela, escolhe min_core e max_core pelo score (o que evaluate() devolve em O(1)) e empurra
+// ate balance_batch threads do mais para o menos carregado. Retorna os cores que receberam threads
+unsigned long PEAMQ::balance()
+{
+    unsigned long long instructions[QUEUES_CORES];
     unsigned long long most_instructions_retired = 0;
     for (unsigned int core = 0; core < CPU::cores(); core++) {
-        if (_core_statistics.instruction_retired[core] > most_instructions_retired)
-            most_instructions_retired = _core_statistics.instruction_retired[core];
+        instructions[core] = advanced(_core_statistics.instruction_retired[core], _window[core].instructions);
+        if (instructions[core] > most_instructions_retired)
+            most_instructions_retired = instructions[core];
     }
-
     // normalizing the value to divide
     most_instructions_retired /= 100;
-    for (unsigned int core = 0; core < CPU::cores(); core++)
-    {
+
+    unsigned long long min = ~0ULL;
+    unsigned long long max = 0;
+    for (unsigned int core = 0; core < CPU::cores(); core++) {
+        // Um core ocioso no modo tickless nao amostra (nao tem quanta): vale o que ele tem executavel agora
+        unsigned long samples = _samples[core] - _window[core].samples;
+        unsigned long demand = _demand[core] - _window[core].demand;
+        _window[core].samples += samples;
+        _window[core].demand += demand;
+        unsigned long load = samples ? demand * LOAD_UNIT / samples : Thread::scheduler()->total_size(core) * LOAD_UNIT;
+
+        unsigned long long branches = advanced(_core_statistics.branch_instruction[core], _window[core].branches);
+        unsigned long long branch_misses = advanced(_core_statistics.branch_misses[core], _window[core].branch_misses);
+        unsigned long long cache_hits = advanced(_core_statistics.cache_hit[core], _window[core].cache_hits);
+        unsigned long long cache_misses = advanced(_core_statistics.cache_misses[core], _window[core].cache_misses);
+
         unsigned long long instruction_retired = 1;
         unsigned long long branch_miss_rate = 1;
         unsigned long long cache_miss_rate = 1;
-        
-        // avaliação com dados da PMU 
-        // branch miss rate = resulta em um valor sem casas decimais, por isso multiplicamos por 100
-        if (_core_statistics.branch_instruction[core])
-            branch_miss_rate = (_core_statistics.branch_misses[core]*100) / _core_statistics.branch_instruction[core];
-        
-        if (_core_statistics.cache_hit[core] + _core_statistics.cache_misses[core])
-            cache_miss_rate = (_core_statistics.cache_misses[core]*100) / (_core_statistics.cache_hit[core] + _core_statistics.cache_misses[core]);
-        
+        if (branches)
+            branch_miss_rate = (branch_misses * 100) / branches;
+        if (cache_hits + cache_misses)
+            cache_miss_rate = (cache_misses * 100) / (cache_hits + cache_misses);
         if (most_instructions_retired)
-            instruction_retired = _core_statistics.instruction_retired[core] / most_instructions_retired;
-
-        // ver em qual intervalo o core_rate se mantém para conseguir fazer a análise de quanto interferir nele com os dados da PMU
+            instruction_retired = instructions[core] / most_instructions_retired;
 
-        unsigned long long core_rate = 0;
-    
-        for (unsigned int q = 0; q < QUEUES; q++)
-        {
-            auto last_element = Thread::scheduler()->tail(core, q);
-            while (last_element && !last_element->object()->criterion().periodic())
-            {
-                last_element = last_element->prev();
-            }
-            
-            if (!last_element)
-            {
-                core_rate += 0;
-            } else {
-                core_rate += last_element->object()->priority() - (((last_element->object()->priority() / 1000) * 125) * q);   // (1 - 0.125 x q)
-            }
-        }
-        // Antes:
-        // long long pmu = branch_miss_rate + cache_miss_rate + instruction_retired; // ~ 300 max
-        
-        // Agora:
-        long long pmu = 1;
+        // Mesmos degraus de antes, agora sobre a janela
+        unsigned long pmu = 1;
         if (cache_miss_rate > 50) {pmu = 20;} // errando muito cache
         else if (branch_miss_rate > 50 && instruction_retired > 70) {pmu = 16;} // errando muito branch e rodando muitas instruções 
         else if (branch_miss_rate > 50 && instruction_retired > 50) {pmu = 14;} // errando muito branch e rodando instruções razoaveis
         else if (branch_miss_rate > 50) {pmu = 12;}  // errando muito branch
         else if (instruction_retired < 30) {pmu = 4;} // por algum motivo rodando poucas instruções (não podemos garantir algo ruim)
-        core_rate = core_rate * pmu;
-        if (core_rate < min)
-        {
-            min = core_rate;
-            chosen_core = core;
+
+        _core_statistics.load[core] = decayed(_core_statistics.load[core], load);
+        _core_statistics.pressure[core] = _core_statistics.pressure[core] ? decayed(_core_statistics.pressure[core], pmu << 4) : pmu << 4;
+        _core_statistics.score[core] = (static_cast<unsigned long long>(_core_statistics.load[core]) * _core_statistics.pressure[core]) >> 4;
+
+        if (_core_statistics.score[core] < min) {
+            min = _core_statistics.score[core];
+            _core_statistics.min_core = core;
         }
-        // P7 : coletar o maximo também 
-        if (max_core) {
-            if (core_rate > max) {
-                max = core_rate;
-                max_core_id = core;
-            }
+        if (_core_statistics.score[core] > max) {
+            max = _core_statistics.score[core];
+            _core_statistics.max_core = core;
         }
     }
-    if (max_core) {
-        return max_core_id;
+
+    // Menor score no dominio de cache de cada core (ver evaluate_near())
+    for (unsigned int core = 0; core < CPU::cores(); core++) {
+        _core_statistics.min_near[core] = core;
+        for (unsigned int other = 0; other < CPU::cores(); other++)
+            if (near(core, other) && (_core_statistics.score[other] < _core_statistics.score[_core_statistics.min_near[core]]))
+                _core_statistics.min_near[core] = other;
     }
+
+    // Dentro do dominio de cache do mais carregado, se la ja ha para onde empurrar ao menos uma thread;
+    // senao, para o menos carregado de todos (e stealable() deixa para tras as que dependem da cache)
+    unsigned int from = _core_statistics.max_core;
+    unsigned int to = _core_statistics.min_core;
+    unsigned int near_to = _core_statistics.min_near[from];
+    if (Traits<EAMQ>::cache_affinity && (_core_statistics.load[from] >= _core_statistics.load[near_to] + 2 * LOAD_UNIT))
+        to = near_to;
+    if ((from == to) || (_core_statistics.load[from] <= _core_statistics.load[to]))
+        return 0;
+
+    // Cada thread empurrada tira uma unidade de um e poe no outro
+    unsigned long pushes = (_core_statistics.load[from] - _core_statistics.load[to]) / (2 * LOAD_UNIT);
+    if (pushes > Traits<EAMQ>::balance_batch)
+        pushes = Traits<EAMQ>::balance_batch;
+
+    unsigned long pushed = 0;
+    for (; pushed < pushes; pushed++) {
+        Thread * t = stealable(from, to);
+        if (!t)
+            break;
+
+        db<PEAMQ>(TRC) << "PEAMQ::balance(" << from << "=>" << to << ") => " << t << endl;
+
+        // Como na migracao em Thread::dispatch(): o core destino rerankeia a thread quando a escolher
+        Thread::scheduler()->remove(t);
+        t->criterion().queue(to);
+        t->criterion()._recently_migrated = true;
+        t->criterion()._priority = LOW;
+        t->criterion().set_queue(QUEUES - 1);
+        t->criterion().reset_pmu_personal_stats();
+        Thread::scheduler()->insert(t);
+    }
+    _core_statistics.load[from] -= pushed * LOAD_UNIT;
+    _core_statistics.load[to] += pushed * LOAD_UNIT;
+
+    return pushed ? (1UL << to) : 0;
+}
+
+// Core de uma thread nova: o de menor score, mas um do dominio de cache de quem a cria (que provavelmente
+// compartilha dados com ela) enquanto ele nao tiver mais de uma thread a mais. Ate o proximo balance(),
+// ela ja conta na carga dele, para que as threads criadas em seguida se espalhem
+unsigned int PEAMQ::place()
+{
+    unsigned int chosen_core = 0;
+    unsigned int near_core = CPU::id();
+    for (unsigned int core = 0; core < CPU::cores(); core++) {
+        if (_core_statistics.score[core] < _core_statistics.score[chosen_core])
+            chosen_core = core;
+        if (near(core, CPU::id()) && (_core_statistics.score[core] < _core_statistics.score[near_core]))
+            near_core = core;
+    }
+    if (Traits<EAMQ>::cache_affinity && (_core_statistics.score[near_core] <= _core_statistics.score[chosen_core] + LOAD_UNIT))
+        chosen_core = near_core;
+
+    unsigned long pressure = _core_statistics.pressure[chosen_core] ? _core_statistics.pressure[chosen_core] : 1 << 4;
+    _core_statistics.load[chosen_core] += LOAD_UNIT;
+    _core_statistics.score[chosen_core] += (static_cast<unsigned long long>(LOAD_UNIT) * pressure) >> 4;
+
     return chosen_core;
 }
 
 void PEAMQ::handle(Event event) {
-    if (periodic() && (event & UPDATE)) {
+    // Rerank da thread migrada no novo core, na primeira vez em que ela e escolhida la
+    // (antes era feito pelo UPDATE que cada dispatch enviava a todas as threads)
+    if (periodic() && (event & ENTER)) {
         if (_recently_migrated) {
             _recently_migrated = false;
-            // preciso remover a thread que está rodando aqui
             rank_eamq();
         }
     }
 
     if (periodic() && (event & LEAVE)) {
-        _core_statistics.instruction_retired[CPU::id()] += PMU::read(2);
-        _core_statistics.branch_misses[CPU::id()] += PMU::read(3);
-        _core_statistics.branch_instruction[CPU::id()] += PMU::read(4);
-        _core_statistics.cache_hit[CPU::id()] += PMU::read(5);
-        _core_statistics.cache_misses[CPU::id()] += PMU::read(6);
-
         // P7 : analisando porcentagem e colocando se necessário migrar
         if (_core_statistics.cache_hit[CPU::id()]) {
             // pode dar divisão por zero
@@ -538,12 +716,7 @@ void PEAMQ::handle(Event event) {
             _personal_statistics.migrate = cm_rate >= 25;
         }
 
-//         P7 : identificar Core menos e mais com score
-//        unsigned int id_max = ANY;
-//        unsigned long long aux = ANY;
-        _core_statistics.min_core = evaluate();
-        _core_statistics.max_core = evaluate(true);
-
+        // P7 : min_core e max_core (ver evaluate()) sao recalculados pelo balanceador periodico, balance()
     }
 
     if (periodic() && (event & FINISH)) {
@@ -557,16 +730,86 @@ void PEAMQ::handle(Event event) {
     EAMQ::handle(event);
 }
 
+// As contagens do quantum (ver EAMQ::account()) tambem somam nas do core em que a thread executou
+void PEAMQ::account(const PMU::Context & pmu) {
+    EAMQ::account(pmu);
+    if (!periodic())
+        return;
+
+    _core_statistics.instruction_retired[CPU::id()] += pmu.last(PMU_INSTRUCTIONS);
+    _core_statistics.branch_misses[CPU::id()] += pmu.last(PMU_BRANCH_MISS);
+    _core_statistics.branch_instruction[CPU::id()] += pmu.last(PMU_BRANCHES);
+    _core_statistics.cache_hit[CPU::id()] += pmu.last(PMU_CACHE_HIT);
+    _core_statistics.cache_misses[CPU::id()] += pmu.last(PMU_CACHE_MISS);
+}
+
 // P7 : função ativado no thread::idle(), verifica qual core cada thread vai migrar
 bool PEAMQ::migrate() {
     // se atual core é o que está sendo mais utilizado e min diferente de max
     // _queue é setado em Variable_Queue_Scheduler na criação do Criterion
     // não faz sentido sair do core atual se houver apenas ele (ele é o problema)
-    if(_core_statistics.max_core == CPU::id() && _core_statistics.min_core != _core_statistics.max_core && Thread::scheduler()->size(_queue) > 1) {
-        db<AAA>(WRN) << "AAAAA!!!! vai mudar para " << _core_statistics.min_core << endl;
-        return true;
+    // so migra (as threads marcadas aqui erram muito a cache) para um core do mesmo dominio de cache (ver evaluate_near())
+    if(_core_statistics.max_core != CPU::id() || Thread::scheduler()->size(_queue) <= 1)
+        return false;
+
+    unsigned int target = evaluate_near(CPU::id());
+    if(target == CPU::id())
+        return false;
+
+    db<PEAMQ>(TRC) << "PEAMQ::migrate(cpu=" << CPU::id() << ") => " << target << endl;
+    return true;
+}
+
+// Roubo de trabalho (ver Thread::steal()): o core com mais threads prontas alem da sua idle, de preferencia
+// um do mesmo dominio de cache. As filas dos outros cores sao lidas sem o lock delas; e so uma dica,
+// stealable() confirma com o lock da vitima
+unsigned int PEAMQ::victim() {
+    unsigned int victim = ANY;
+    unsigned int near_victim = ANY;
+    unsigned long most = 1; // so a idle (ou nada) pronta: nao ha o que roubar
+    unsigned long most_near = 1;
+    for (unsigned int core = 0; core < CPU::cores(); core++) {
+        if (core == CPU::id())
+            continue;
+        unsigned long ready = Thread::scheduler()->total_size(core);
+        if (ready > most) {
+            most = ready;
+            victim = core;
+        }
+        if (near(core, CPU::id()) && (ready > most_near)) {
+            most_near = ready;
+            near_victim = core;
+        }
+    }
+    return (Traits<EAMQ>::cache_affinity && (near_victim != ANY)) ? near_victim : victim;
+}
+
+// Thread pronta (nunca o chosen, que fica fora das subfilas) que o core pode ceder a to sem perder deadline:
+// uma aperiodica, se houver, senao a periodica com mais folga (deadline restante - execucao restante),
+// desde que a folga passe de um quantum. Comeca pelo fim das subfilas, onde estao as que esperariam mais.
+// Para fora do dominio de cache, nunca as que erram muito a cache (migrate, ver handle()): la elas
+// perderiam o que tem na L2 e ganhariam menos do que isso custa
+Thread * PEAMQ::stealable(unsigned int core, unsigned int to) {
+    bool cross = Traits<EAMQ>::cache_affinity && !near(core, to);
+    Thread * chosen = 0;
+    long most = Traits<Thread>::QUANTUM;
+    for (unsigned int q = QUEUES; q-- > 0;) {
+        for (auto e = Thread::scheduler()->tail(core, q); e; e = e->prev()) {
+            Thread * t = e->object();
+            if ((t->priority() == IDLE) || (t->priority() == MAIN))
+                continue;
+            if (cross && t->criterion().personal_statistics().migrate)
+                continue;
+            if (!t->criterion().periodic())
+                return t;
+            long slack = long(t->criterion().remaining_deadline()) - long(t->criterion().personal_statistics().remaining_et[t->criterion().queue_eamq()]);
+            if (slack > most) {
+                most = slack;
+                chosen = t;
+            }
+        }
     }
-    return false;
+    return chosen;
 }
 
 
@@ -3,6 +3,10 @@
 #include <system.h>
 #include <time.h>
 #include <process.h>
+#include <dvfs.h>
+#include <energy.h>
+#include <idle.h>
+#include <architecture/profiler.h>
 
 __BEGIN_SYS
 
@@ -15,8 +19,15 @@ void System::init()
     }
 
     // These abstractions are initialized by all CPUs
+    DVFS_Governor::init();
+    Energy_Meter::init();
+    Idle_Manager::init();
+
     if(Traits<Thread>::enabled)
         Thread::init();
+
+    // Samples the running thread, so only after Thread::init() has created them
+    Profiler::init();
 }
 
 __END_SYS
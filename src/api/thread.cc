@@ -3,6 +3,8 @@
 #include <machine.h>
 #include <system.h>
 #include <process.h>
+#include <time.h>
+#include <idle.h>
 
 __BEGIN_SYS
 
@@ -12,7 +14,12 @@ bool Thread::_not_booting;
 volatile unsigned int Thread::_thread_count;
 Scheduler_Timer *Thread::_timer;
 Scheduler<Thread> Thread::_scheduler;
-Spin Thread::_lock;
+Spin Thread::_lock[Thread::LOCKS];
+volatile unsigned long Thread::_locked_by[Traits<Machine>::CPUS];
+Thread * volatile Thread::_inbox[Traits<Machine>::CPUS];
+Thread::Wakeup Thread::_reschedule_pending[Traits<Machine>::CPUS];
+bool Thread::_batching[Traits<Machine>::CPUS];
+unsigned long Thread::_batched[Traits<Machine>::CPUS];
 
 void Thread::constructor_prologue(unsigned int stack_size)
 {
@@ -60,6 +67,21 @@ Thread::~Thread()
     // ainda não consegui ver o destrutor funcionando nenhuma vez
 
     db<PEAMQ>(WRN) << "Chamou o destrutor" << endl;
+
+    // A thread waiting on a synchronizer leaves its queue with the synchronizer's lock, which is taken before the
+    // scheduler locks (see sleep()), and is then destroyed as a suspended one
+    CPU::int_disable();
+    if(Spin * guard = _guard) {
+        guard->acquire();
+        if(_waiting) {
+            _waiting->remove(this);
+            _waiting = 0;
+            _guard = 0;
+            _state = SUSPENDED;
+        }
+        guard->release();
+    }
+
     lock();
     db<PEAMQ>(WRN) << "Lockou no destrutor" << endl;
 
@@ -74,6 +96,8 @@ Thread::~Thread()
     // The running thread cannot delete itself!
     assert(_state != RUNNING);
 
+    settle();
+
     switch (_state)
     {
     case RUNNING: // For switch completion only: the running thread would have deleted itself! Stack wouldn't have been released!
@@ -119,7 +143,14 @@ void Thread::priority(Criterion c)
     unsigned long old_cpu = _link.rank().queue();
     unsigned long new_cpu = c.queue();
 
-    if(_state != RUNNING) { // reorder the scheduling queue
+    if(settle()) { // not inserted yet: post it again, now to the inbox of its new core
+        _link.rank(c);
+        post(this);
+        if(remote())
+            reschedule(new_cpu);
+        else
+            drain(new_cpu);
+    } else if(_state != RUNNING) { // reorder the scheduling queue
         _scheduler.suspend(this);
         // We dont throw the rerank event here because we are explicitly changing the priority
         _link.rank(c);
@@ -180,6 +211,10 @@ void Thread::pass()
     
     db<Thread>(TRC) << "Thread::pass(this=" << this << ")" << endl;
 
+    // Only this core consumes its own inbox; a thread posted to another one is not ready here anyway
+    if(posted() && !remote())
+        drain(CPU::id());
+
     Thread *prev = running();
     // db<GEAMQ>(WRN) << "PASS prev: " << prev << endl;
     prev->criterion().handle(EAMQ::CHANGE_QUEUE);
@@ -199,6 +234,11 @@ void Thread::suspend()
 
     db<Thread>(TRC) << "Thread::suspend(this=" << this << ")" << endl;
 
+    if(settle()) { // never inserted, so there is nothing to take out of the scheduler
+        unlock();
+        return;
+    }
+
     Thread *prev = running();
 
     _state = SUSPENDED;
@@ -214,23 +254,30 @@ void Thread::suspend()
 
 void Thread::resume()
 {
-    lock();
+    // Only the lock of the thread's core: it serializes the resumers and covers the local insertion (a remote one is posted)
+    lock(_link.rank().queue());
 
     db<GEAMQ>(TRC) << "Thread::resume(this=" << this << ") state= " << _state << endl;
 
     if (_state == SUSPENDED)
     {
-        _state = READY;
-        // Recalcular rank antes de voltar 
-        db<GEAMQ>(TRC) << "Calling handle" << endl;
-        this->criterion().handle(EAMQ::RESUME_THREAD);
-
-        db<GEAMQ>(TRC) << "Calling resume" << endl;
-        _scheduler.resume(this);
-
-        if(preemptive) {
-            db<GEAMQ>(TRC) << "Calling reschedule" << endl;
+        if (remote()) {
+            // O core da thread faz o rerank e a insercao (ver drain())
+            post(this);
             reschedule(_link.rank().queue());
+        } else {
+            _state = READY;
+            // Recalcular rank antes de voltar 
+            db<GEAMQ>(TRC) << "Calling handle" << endl;
+            this->criterion().handle(EAMQ::RESUME_THREAD);
+
+            db<GEAMQ>(TRC) << "Calling resume" << endl;
+            _scheduler.resume(this);
+
+            if(preemptive) {
+                db<GEAMQ>(TRC) << "Calling reschedule" << endl;
+                reschedule(_link.rank().queue());
+            }
         }
     } else
         db<GEAMQ>(TRC) << "Resume called for unsuspended object!" << endl;
@@ -240,7 +287,7 @@ void Thread::resume()
 
 void Thread::yield()
 {
-    lock();
+    lock(CPU::id());
 
     db<Thread>(TRC) << "Thread::yield(running=" << running() << ")" << endl;
 
@@ -290,17 +337,24 @@ void Thread::exit(int status)
     unlock();
 }
 
-void Thread::sleep(Queue *q)
+void Thread::sleep(Queue *q, Spin *guard)
 {
-    assert(locked()); // locking handled by caller
-    
+    assert(guard->taken()); // q's locking handled by caller
+
+    lock(CPU::id());
+
     Thread *prev = running();
     prev->criterion().handle(EAMQ::CHANGE_QUEUE);
     _scheduler.suspend(prev);
     prev->_state = WAITING;
     prev->_waiting = q;
+    prev->_guard = guard;
     q->insert(&prev->_link);
 
+    // A waker may find prev in q from now on, but it only posts prev to the inbox of this core, which is drained
+    // with this core's lock, i.e. after dispatch()
+    guard->release();
+
     Thread *next = _scheduler.chosen();
     //db<PEAMQ>(WRN) << "PREV: " << prev->link() << ", NEXT: "<< next->link() << endl;
     // if (next == nullptr) {
@@ -309,31 +363,21 @@ void Thread::sleep(Queue *q)
 
     dispatch(prev, next);
 
+    unlock();
 }
 
 void Thread::wakeup(Queue *q)
 {
-    assert(locked()); // locking handled by caller
+    assert(CPU::int_disabled()); // q's locking handled by caller
 
     if (!q->empty())
     {
-
         Thread *t = q->remove()->object();
-        
-        t->_state = READY;
-        t->_waiting = 0;
-
-
-        t->criterion().handle(EAMQ::RESUME_THREAD);
-
-        // TODO: Throw a new event to recalculate rank from behind when the thread is woken up
-        _scheduler.resume(t);
-
-
-        if(preemptive) {
-            reschedule(t->_link.rank().queue());
 
-        }
+        // Only the core t is partitioned to inserts it, with its own lock (see drain() and deliver())
+        post(t);
+        if (t->remote())
+            reschedule_or_batch(1UL << t->_link.rank().queue());
     }
 }
 
@@ -341,28 +385,61 @@ void Thread::wakeup_all(Queue *q)
 {
     db<Thread>(TRC) << "Thread::wakeup_all(running=" << running() << ",q=" << q << ")" << endl;
 
-    assert(locked()); // locking handled by caller
+    assert(CPU::int_disabled()); // q's locking handled by caller
 
     if(!q->empty()) {
         assert(Criterion::QUEUES <= sizeof(unsigned long) * 8);
         unsigned long cpus = 0;
         while(!q->empty()) {
             Thread * t = q->remove()->object();
-            t->_state = READY;
-            t->_waiting = 0;
-            _scheduler.resume(t);
-            cpus |= 1 << t->_link.rank().queue();
+            post(t);
+            if(t->remote())
+                cpus |= 1UL << t->_link.rank().queue();
         }
 
-        // P3 - Alteração 
-        if(preemptive) {
-            for(unsigned long i = 0; i < Criterion::QUEUES; i++)
-                if(cpus & (1 << i))
-                    reschedule(i);
-        }
+        reschedule_or_batch(cpus);
+    }
+}
+
+// Inserts the threads woken up by this core that are partitioned to it (see post()), with nothing but this core's lock
+void Thread::deliver()
+{
+    unsigned int cpu = CPU::id();
+    if(!_inbox[cpu])
+        return;
+
+    lock(cpu);
+    drain(cpu);
+    if(preemptive)
+        reschedule_or_batch(1UL << cpu);
+    unlock();
+}
+
+void Thread::batch(bool on)
+{
+    assert(locked()); // locking handled by caller
+
+    unsigned int cpu = CPU::id();
+    unsigned long cpus = _batched[cpu];
+    _batching[cpu] = on;
+    _batched[cpu] = 0;
+
+    if(!on && cpus) {
+        db<Thread>(TRC) << "Thread::batch(cpus=" << hex << cpus << dec << ")" << endl;
+        reschedule_cpus(cpus);
     }
 }
 
+void Thread::reschedule_or_batch(unsigned long cpus)
+{
+    if(_batching[CPU::id()])
+        _batched[CPU::id()] |= cpus;
+    else if(cpus & (cpus - 1))
+        reschedule_cpus(cpus);
+    else if(cpus)
+        reschedule(Math::lsb(cpus));
+}
+
 void Thread::reschedule()
 {
     if (!Criterion::timed || Traits<Thread>::hysterically_debugged)
@@ -377,34 +454,147 @@ void Thread::reschedule()
     prev->criterion().handle(EAMQ::CHANGE_QUEUE);
     Thread *next = _scheduler.choose();
     db<PEAMQ>(WRN) << "!!Thread NEXT: " << next << endl;    
+    if(Timer::tickless && (next->priority() != IDLE)) // idle() programs its own
+        tickless(false);
     dispatch(prev, next);
 }
 
+// The timer of this core may skip ticks if nothing but the running thread (or, if idle, nothing at all) is ready
+// here: it only needs to fire for the next alarm of this core and, unless idle, at the end of the time slice
+void Thread::tickless(bool idle)
+{
+    if(idle || (_scheduler.occupied_queues() <= 1))
+        Timer::one_shot(Alarm::next_tick(), !idle);
+    else
+        Timer::periodic();
+}
+
 
+// Other cores need no lock here: they reschedule themselves in rescheduler()
 void Thread::reschedule(unsigned int cpu)
 {
-    assert(locked()); // locking handled by caller
-
     if(!smp || (cpu == CPU::id()))
         reschedule();
-    else {
+    else if(!CPU::tsl(_reschedule_pending[cpu].pending) && !Idle_Manager::listening(cpu)) { // cpu hasn't acknowledged the previous IPI yet (see rescheduler()) or will see the flag (see idle())
         db<Thread>(TRC) << "Thread::reschedule(cpu=" << cpu << ")" << endl;
         IC::ipi(cpu, IC::INT_RESCHEDULER);
     }
 }
 
+void Thread::reschedule_cpus(unsigned long cpus)
+{
+    if(!smp) {
+        if(cpus)
+            reschedule();
+        return;
+    }
+
+    bool self = cpus & (1UL << CPU::id());
+    unsigned long targets = 0;
+    for(unsigned int i = 0; i < Traits<Machine>::CPUS; i++)
+        if((i != CPU::id()) && (cpus & (1UL << i)) && !CPU::tsl(_reschedule_pending[i].pending) && !Idle_Manager::listening(i))
+            targets |= 1UL << i;
+
+    if(targets) {
+        db<Thread>(TRC) << "Thread::reschedule(cpus=" << hex << targets << dec << ")" << endl;
+        IC::ipi_multicast(targets, IC::INT_RESCHEDULER);
+    }
+
+    if(self)
+        reschedule();
+}
+
 
 void Thread::rescheduler(IC::Interrupt_Id i)
 {
-    lock();
+    lock(CPU::id());
+    // Acknowledge before draining, so a wakeup posted from now on sends a new IPI
+    _reschedule_pending[CPU::id()].pending = false;
+    drain(CPU::id());
     reschedule();
     unlock();
 }
 
+void Thread::post(Thread * t)
+{
+    unsigned int cpu = t->_link.rank().queue();
+
+    db<Thread>(TRC) << "Thread::post(t=" << t << ",cpu=" << cpu << ")" << endl;
+
+    t->_state = WAITING;
+    t->_waiting = 0;
+    t->_guard = 0;
+
+    Thread * head;
+    do {
+        head = _inbox[cpu];
+        t->_posted = head;
+    } while(CPU::cas(_inbox[cpu], head, t) != head);
+}
+
+bool Thread::settle()
+{
+    assert(locked()); // lock() holds _lock[queue] as well, so the owner is not draining the inbox meanwhile
+
+    if(!posted())
+        return false;
+
+    unsigned int cpu = _link.rank().queue();
+
+    db<Thread>(TRC) << "Thread::settle(this=" << this << ",cpu=" << cpu << ")" << endl;
+
+    // Posters only swing the head, so either this thread is still the head or its predecessor's link is stable
+    if((_inbox[cpu] != this) || (CPU::cas(_inbox[cpu], this, static_cast<Thread *>(_posted)) != this)) {
+        Thread * p = _inbox[cpu];
+        while(p->_posted != this)
+            p = p->_posted;
+        p->_posted = _posted;
+    }
+
+    _posted = 0;
+    _state = SUSPENDED;
+
+    return true;
+}
+
+void Thread::drain(unsigned int queue)
+{
+    assert(locked()); // the owner of _lock[queue] is the only consumer of _inbox[queue]
+
+    Thread * list;
+    do
+        list = _inbox[queue];
+    while(list && (CPU::cas(_inbox[queue], list, static_cast<Thread *>(0)) != list));
+
+    // The inbox is a LIFO; restore the posting order before inserting
+    Thread * fifo = 0;
+    while(list) {
+        Thread * t = list;
+        list = t->_posted;
+        t->_posted = fifo;
+        fifo = t;
+    }
+
+    while(fifo) {
+        Thread * t = fifo;
+        fifo = t->_posted;
+        t->_posted = 0;
+
+        db<Thread>(TRC) << "Thread::drain(cpu=" << queue << ") => " << t << endl;
+
+        t->_state = READY;
+        t->criterion().handle(EAMQ::RESUME_THREAD);
+        _scheduler.resume(t);
+    }
+}
+
 
 void Thread::time_slicer(IC::Interrupt_Id i)
 {
-    lock();
+    if(smp && Criterion::balanced && Criterion::sample())
+        balance();
+
+    lock(CPU::id());
     reschedule();
     unlock();
 }
@@ -417,18 +607,36 @@ void Thread::dispatch(Thread *prev, Thread *next, bool charge)
 
     if (prev != next)
     {
+        if (Criterion::metered)
+            prev->criterion().consume(Energy_Meter::claim());
+
+        // The counters stay frozen until next's are loaded, so the scheduler itself is not charged to anyone
+        if (Criterion::monitored) {
+            prev->_pmu.save();
+            prev->criterion().account(prev->_pmu);
+        }
+
         if (Criterion::dynamic)
         {
             prev->criterion().handle(Criterion::CHARGE | Criterion::LEAVE);
-            for_all_threads(Criterion::UPDATE);
+            if (!Criterion::lazy_update)
+                for_all_threads(Criterion::UPDATE);
             next->criterion().handle(Criterion::AWARD | Criterion::ENTER);
+            if (Criterion::lazy_update)
+                Criterion::elapse(); // one quantum for the threads still waiting in the current queue, in O(1)
 
             // P7 : se migração é ativo e condição para migrar for satisfeito
-            if (Criterion::migration && next->criterion().periodic() && next->criterion().personal_statistics().migrate && next->criterion().migrate()) {
+            // A fila do core destino só é travada se estiver livre (try_acquire); se não estiver,
+            // a migração fica para o próximo dispatch, assim um core nunca espera pelo lock de outro
+            unsigned int min_core = Criterion::evaluate_near(CPU::id());
+            unsigned long target = 1UL << (min_core % LOCKS);
+            bool remote = false;
+            if (Criterion::migration && next->criterion().periodic() && next->criterion().personal_statistics().migrate && next->criterion().migrate()
+                && (!smp || (_locked_by[CPU::id()] & target) || (remote = try_acquire(target)))) {
                 // não sei se é melhor alterar evaluate para receber um parametro para não escolher mesmo core...
                 db<AAA>(WRN) << "NEXT: " << next << endl;
 
-                next->criterion().queue(next->criterion().core_Statistics().min_core); // atribui o novo core que a thread vai migrar
+                next->criterion().queue(min_core); // atribui o novo core que a thread vai migrar
                 // Novo core precisa rerankear a thread
                 // next->criterion().rank_eamq();                   // atribui novo rank no novo core
                 next->criterion()._recently_migrated = true;
@@ -439,9 +647,14 @@ void Thread::dispatch(Thread *prev, Thread *next, bool charge)
                 next = _scheduler.migrate();                                // escolhe novo proximo
                 db<AAA>(WRN) << "NEXT: " << next << endl;
 
+                if (remote)
+                    release(target);
+
                 // Como há reatribuição ao next ele pode ser igual ao prev novamente
                 if (prev == next) {
                     db<PEAMQ>(WRN) << "Migramos a thread e o next voltou a ser o prev!" << endl;
+                    if (Criterion::monitored)
+                        next->_pmu.load();
                     return;
                 }
             }
@@ -459,8 +672,15 @@ void Thread::dispatch(Thread *prev, Thread *next, bool charge)
             db<Thread>(INF) << "Thread::dispatch:prev={" << prev << ",ctx=" << tmp << "}" << endl;
         }
         db<Thread>(INF) << "Thread::dispatch:next={" << next << ",ctx=" << *next->_context << "}" << endl;
+
+        if (Criterion::monitored)
+            next->_pmu.load();
+
+        // Locks are released before switching and taken back (in ascending order) by prev when it resumes,
+        // possibly on another CPU
+        unsigned long held = _locked_by[CPU::id()];
         if(smp)
-            _lock.release();
+            release(held);
 
         // The non-volatile pointer to volatile pointer to a non-volatile context is correct
         // and necessary because of context switches, but here, we are locked() and
@@ -470,11 +690,60 @@ void Thread::dispatch(Thread *prev, Thread *next, bool charge)
         CPU::switch_context(const_cast<Context **>(&prev->_context), next->_context);
 
         if(smp)
-            _lock.acquire();
+            acquire(held);
 
     }
 }
 
+// An idle core pulls a ready thread from the most loaded one (see Criterion::victim() and stealable()) and
+// makes it its own. As with migration in dispatch(), the victim's queue is only locked if it is free, so an
+// idle core never waits for a busy one and the lock order holds
+bool Thread::steal()
+{
+    unsigned int cpu = CPU::id();
+    unsigned int victim = Criterion::victim();
+    if(victim == Criterion::ANY)
+        return false;
+
+    lock(cpu);
+
+    Thread * t = 0;
+    unsigned long target = 1UL << (victim % LOCKS);
+    bool remote = false;
+    if((_locked_by[cpu] & target) || (remote = try_acquire(target))) {
+        t = Criterion::stealable(victim, cpu);
+        if(t) {
+            db<Thread>(TRC) << "Thread::steal(cpu=" << cpu << ",victim=" << victim << ") => " << t << endl;
+
+            _scheduler.remove(t);
+            t->criterion().queue(cpu);
+            t->criterion().reset_pmu_personal_stats(); // the counters sampled on the victim don't describe this core
+            t->criterion().handle(EAMQ::RESUME_THREAD); // rerank it among the sub-queues of this core
+            _scheduler.resume(t);
+        }
+        if(remote)
+            release(target);
+    }
+
+    unlock();
+
+    return t;
+}
+
+// Every Traits<EAMQ>::balance_period quanta (counted over all cores), the core that closes the period refreshes
+// the load and PMU pressure of each core and pushes threads from the most to the least loaded one (see
+// Criterion::balance()). The pushed threads are reranked when first chosen on their new core
+void Thread::balance()
+{
+    lock();
+
+    unsigned long cpus = Criterion::balance();
+    if(cpus)
+        reschedule_cpus(cpus);
+
+    unlock();
+}
+
 int Thread::idle()
 {
 
@@ -483,8 +752,32 @@ int Thread::idle()
         if(Traits<Thread>::trace_idle)
             db<Thread>(TRC) << "Thread::idle(cpu=" << CPU::id() << ",this=" << running() << ")" << endl;
 
-        CPU::int_enable();
-        CPU::halt();
+        // Rather than sleeping while another core has threads waiting
+        if(smp && Criterion::stealing && steal()) {
+            yield();
+            continue;
+        }
+
+        // Until the next alarm or, with a timed criterion, the next time slice
+        Microsecond predicted = Alarm::next();
+        if(Criterion::timed && (Time_Base(predicted) > Traits<Thread>::QUANTUM))
+            predicted = Traits<Thread>::QUANTUM;
+
+        unsigned int cpu = CPU::id();
+        if(Timer::tickless) {
+            CPU::int_disable();
+            tickless(true);
+            CPU::int_enable();
+        }
+        Idle_Manager::sleep(predicted, _reschedule_pending[cpu].pending);
+
+        // A remote wakeup that only wrote the flag (no IPI): do what rescheduler() would have done
+        if(smp && _reschedule_pending[cpu].pending) {
+            lock(cpu);
+            _reschedule_pending[cpu].pending = false;
+            drain(cpu);
+            unlock();
+        }
 
         if(_scheduler.schedulables() > 0) // a thread might have been woken up by another CPU
         {
@@ -6,6 +6,7 @@ __BEGIN_SYS
 
 unsigned int CPU::_cpu_clock;
 unsigned int CPU::_bus_clock;
+unsigned int CPU::_cache_domain[Traits<Build>::CPUS];
 
 void CPU::Context::save() volatile
 {
@@ -10,6 +10,12 @@ void CPU::init()
 {
     db<Init, CPU>(TRC) << "CPU::init()" << endl;
 
+    if(multicore) {
+        Reg32 mpidr;
+        ASM("mrs %0, mpidr_el1" : "=r"(mpidr) : : );
+        _cache_domain[id()] = (mpidr >> 8) & 0xff;
+    }
+
     if(CPU::id() == CPU::BSP) {
         if(Traits<MMU>::enabled)
             MMU::init();
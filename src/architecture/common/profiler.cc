@@ -0,0 +1,65 @@
+// EPOS PMU-based Sampling Profiler Implementation
+
+#include <architecture/profiler.h>
+#include <machine/ic.h>
+#include <process.h>
+
+__BEGIN_SYS
+
+Profiler::Sample Profiler::_ring[Traits<Machine>::CPUS][Profiler::SAMPLES];
+volatile unsigned long Profiler::_head[Traits<Machine>::CPUS];
+volatile unsigned long Profiler::_tail[Traits<Machine>::CPUS];
+volatile unsigned long Profiler::_lost[Traits<Machine>::CPUS];
+
+void Profiler::init()
+{
+    if(!enabled)
+        return;
+
+    if(CPU::id() == CPU::BSP)
+        PMU::handler(new (SYSTEM) Function_Handler(&sample), CHANNEL);
+    PMU::int_enable();
+    start();
+}
+
+void Profiler::start()
+{
+    PMU::period(CHANNEL, Traits<EAMQ>::profiler_period);
+    PMU::interrupt(CHANNEL, true);
+    PMU::start(CHANNEL);
+}
+
+void Profiler::stop()
+{
+    PMU::interrupt(CHANNEL, false);
+}
+
+// PMI do canal (interrupcoes desabilitadas, no core que estourou)
+void Profiler::sample()
+{
+    unsigned int cpu = CPU::id();
+    PMU::period(CHANNEL, Traits<EAMQ>::profiler_period);
+
+    unsigned long head = _head[cpu];
+    if(head - _tail[cpu] >= SAMPLES) {
+        _lost[cpu]++;
+        return;
+    }
+
+    Sample & s = _ring[cpu][head % SAMPLES];
+    s.ip = IC::interrupted_ip();
+    s.thread = Thread::self();
+    CPU::finc(_head[cpu]); // publishes the sample (a full barrier)
+}
+
+unsigned int Profiler::dump(unsigned int cpu, Sample * samples, unsigned int n)
+{
+    unsigned int i = 0;
+    for(; (i < n) && (_tail[cpu] != _head[cpu]); i++) {
+        samples[i] = _ring[cpu][_tail[cpu] % SAMPLES];
+        CPU::finc(_tail[cpu]); // frees the slot only after it was copied
+    }
+    return i;
+}
+
+__END_SYS
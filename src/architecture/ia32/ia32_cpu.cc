@@ -8,6 +8,7 @@
 __BEGIN_SYS
 
 volatile unsigned int CPU::_cores;
+unsigned int CPU::_cache_domain[Traits<Build>::CPUS];
 Hertz CPU::_cpu_clock;
 Hertz CPU::_cpu_current_clock;
 Hertz CPU::_bus_clock;
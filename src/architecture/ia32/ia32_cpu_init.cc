@@ -14,6 +14,9 @@ void CPU::init()
     _cpu_current_clock = System::info()->tm.cpu_clock;
     _bus_clock = System::info()->tm.bus_clock;
 
+    _cache_domain[id()] = l2_domain();
+    db<Init, CPU>(INF) << "CPU::init:cache_domain[" << id() << "]=" << _cache_domain[id()] << endl;
+
     // Initialize the MMU
     if(CPU::id() == CPU::BSP) {
         if(Traits<MMU>::enabled)
@@ -56,6 +59,41 @@ void CPU::init()
     }
 }
 
+// The x2APIC ID of this core (leaf 0xB, or the initial APIC ID of leaf 1) without the bits that tell apart the
+// logical processors sharing its L2 (leaf 4). Without leaf 4, every core is taken to share the same cache domain
+unsigned int CPU::l2_domain()
+{
+    Reg32 a, b, c = 0, d;
+    cpuid(0, &a, &b, &c, &d);
+    Reg32 max = a;
+    if(max < 4)
+        return 0;
+
+    c = 0;
+    cpuid(1, &a, &b, &c, &d);
+    Reg32 apic_id = b >> 24;
+    if(max >= 0xb) {
+        c = 0;
+        cpuid(0xb, &a, &b, &c, &d);
+        if(b) // leaf 0xB is implemented
+            apic_id = d;
+    }
+
+    for(Reg32 i = 0; ; i++) {
+        c = i;
+        cpuid(4, &a, &b, &c, &d);
+        if(!(a & 0x1f)) // no more caches
+            return 0;
+        if(((a >> 5) & 0x7) == 2) {
+            Reg32 sharing = ((a >> 14) & 0xfff) + 1;
+            unsigned int bits = 0;
+            while((1U << bits) < sharing)
+                bits++;
+            return apic_id >> bits;
+        }
+    }
+}
+
 void CPU::smp_barrier_init(unsigned int cores) {
     // Core activation in IA32 is handled by the APIC
     _cores = cores;
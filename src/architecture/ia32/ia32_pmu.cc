@@ -4,52 +4,36 @@
 
 __BEGIN_SYS
 
+void PMU::int_enable()
+{
+    db<PMU>(TRC) << "PMU::int_enable()" << endl;
+
+    IC::int_vector(IC::INT_PMU, int_handler);
+    APIC::config_pmu(IC::INT_PMU);
+}
+
+void PMU::int_disable()
+{
+    db<PMU>(TRC) << "PMU::int_disable()" << endl;
+
+    APIC::disable_pmu();
+}
+
 void PMU::int_handler(Interrupt_Id i)
 {
-//
-//        //db< Init, Intel_PMU_V1 >(WRN) << "Intel_PMU_V1::PMU_int_handler()\n";
-//
-//        Reg64 perf_ovf_msr;// pebs_enable_msr, pmcs_enable_msr;
-//
-//        // Get overflow status register value
-//        perf_ovf_msr = global_overflow_status();
-//        // kout << read(FIXED) << "    canal:FIXED   cpu:" << "  overflow:" << overflow() << "   thread:" << endl;
-//
-//        // PMC Handlers
-//        if(overflow())
-//        {
-//           // kout << "OVERFLOW" << endl;
-//
-//            for(Channel i=0; i<CHANNELS;i++)
-//            {
-//                if(perf_ovf_msr&(1ULL << i))
-//                {
-//                    stop(i+FIXED);
-//                    clear_overflow(i+FIXED);
-//                    start(i+FIXED);
-//                }
-//            }
-//
-//            db<Init, Intel_PMU_V1>(INF) << "Intel_PMU_V1::PMC_overflow(" << APIC::id() << ");" << endl;
-//        }
-//
-//        // Overflow Changed flag
-//        clear_cond_changed();
-//
-//        // Clearing the mask bit in the performance counter LVT entry.
-//        APIC::enable_perf();
-//        // kout << read(FIXED) << "    canal:FIXED   cpu:"  << "  overflow:" << overflow() << "   thread:" << endl;
-//
-//        for(Reg32 i = 0; i < CHANNELS; i++)
-//        {
-//            // For each PMC: verify if it's handler is set and an overflow occurred
-//            if((_pmc_handler[i] != 0) && ((perf_ovf_msr&(1ULL << i)) != 0))
-//            {
-//                // Then, call this handler
-//                _pmc_handler[i]();
-//            }
-//        }
-//        // kout << read(FIXED) << "    canal:FIXED   cpu:" << "  overflow:" << overflow() << "   thread:" << endl;
+    Reg64 status = global_overflow_status();
+    for(Channel c = 0; c < CHANNELS; c++) {
+        Reg64 overflow = (c < FIXED) ? (1ULL << (CRT0_OVERFLOW + c)) : (1ULL << (PMC0_OVERFLOW + c - FIXED));
+        if(status & overflow) {
+            clear_overflow(c);
+            if(_handlers[c])
+                (*_handlers[c])();
+        }
+    }
+    clear_cond_changed();
+
+    // Delivering a PMI masks LVT_PERF
+    APIC::enable_pmu();
 }
 
 __END_SYS
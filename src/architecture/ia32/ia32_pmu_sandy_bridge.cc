@@ -4,6 +4,19 @@
 
 __BEGIN_SYS
 
+Handler * Intel_Sandy_Bridge_PMU::_handlers[Intel_Sandy_Bridge_PMU::CHANNELS];
+
+// The events of channels 3 to 6 in CPU::init()
+const Intel_Sandy_Bridge_PMU::Event Intel_Sandy_Bridge_PMU::_defaults[Intel_Sandy_Bridge_PMU::CHANNELS - Intel_Sandy_Bridge_PMU::FIXED] = {
+    15, // Branch miss
+    11, // Branches
+    24, // Cache hit (L1)
+    25  // Cache miss (L1)
+};
+CPU::Reg64 Intel_Sandy_Bridge_PMU::_global[Traits<Build>::CPUS];
+Intel_Sandy_Bridge_PMU::Count Intel_Sandy_Bridge_PMU::_base[Traits<Build>::CPUS][Intel_Sandy_Bridge_PMU::CHANNELS - Intel_Sandy_Bridge_PMU::FIXED + 1];
+CPU::Reg64 Intel_Sandy_Bridge_PMU::_evtsel[Traits<Build>::CPUS][Intel_Sandy_Bridge_PMU::CHANNELS - Intel_Sandy_Bridge_PMU::FIXED];
+
 const Intel_Sandy_Bridge_PMU::Event Intel_Sandy_Bridge_PMU::_events[EVENTS] = {
     UNHALTED_REFERENCE_CYCLES,          // CPU_CYCLES,
     UNHALTED_CORE_CYCLES,               // UNHALTED_CYCLES,
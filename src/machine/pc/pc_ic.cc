@@ -11,6 +11,7 @@ __BEGIN_SYS
 
 APIC::Log_Addr APIC::_base;
 IC::Interrupt_Handler IC::_int_vector[IC::INTS];
+CPU::Context * volatile IC::_interrupted[Traits<Machine>::CPUS];
 
 // This function has to be here (and not in pc_ic_init.cc) because it is used by SETUP, which cannot be linked against libinit.a
 void APIC::ipi_init(volatile int * status)
@@ -64,6 +65,23 @@ void APIC::ipi(unsigned int cpu, unsigned int interrupt)
     while((read(ICR0_31) & ICR_PENDING));
 }
 
+// Sends interrupt to all CPUs in the cpus bitmap (bit n => CPU n) with a single ICR write
+void APIC::ipi_multicast(unsigned long cpus, unsigned int interrupt)
+{
+    unsigned long others = ((1UL << Traits<Machine>::CPUS) - 1) & ~(1UL << id());
+
+    if(!cpus)
+        return;
+
+    if(cpus == others) // the "all excluding self" shorthand needs no destination
+        write(ICR0_31, ICR_OTHERS | ICR_LEVEL | ICR_ASSERT | ICR_FIXED | interrupt);
+    else {
+        write(ICR32_63, (cpus & 0xff) << 24);
+        write(ICR0_31, ICR_LOG | ICR_LEVEL | ICR_ASSERT | ICR_FIXED | interrupt);
+    }
+    while((read(ICR0_31) & ICR_PENDING));
+}
+
 
 void IC::dispatch(unsigned int i)
 {
@@ -870,6 +888,25 @@ void IC::entry()
     CPU::Context::pop(true);
 };
 
+// PMU interrupts have their own entry, so the handler (e.g., a sampling profiler) can get the interrupted context.
+// The PMI comes from the local APIC (LVT_PERF) even if IC is the i8259A, so the EOI always goes to the APIC.
+void IC::pmu_entry()
+{
+    ASM("       pusha                   # push registers (a CPU::Context)       \n"
+        "       push    %%esp           # pmu_dispatch(context)                 \n"
+        "       call    %P0                                                     \n"
+        "       add     $4, %%esp                                               \n"
+        "       popa                                                            \n"
+        "       iret                                                            \n" : : "i"(&pmu_dispatch));
+}
+
+void IC::pmu_dispatch(CPU::Context * context)
+{
+    _interrupted[CPU::id()] = context;
+    APIC::eoi(INT_PMU);
+    _int_vector[INT_PMU](INT_PMU);
+}
+
 // Default logical handler
 void IC::int_not(Interrupt_Id i)
 {
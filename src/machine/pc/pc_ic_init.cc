@@ -24,6 +24,7 @@ void IC::init()
     idt[CPU::EXC_DOUBLE] = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_pf),  CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_GPF]    = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_gpf), CPU::SEG_IDT_ENTRY);
     idt[CPU::EXC_NODEV]  = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&exc_fpu), CPU::SEG_IDT_ENTRY);
+    idt[INT_PMU]         = CPU::IDT_Entry(CPU::SEL_SYS_CODE, Log_Addr(&pmu_entry), CPU::SEG_IDT_ENTRY);
 
     // Set all interrupt handlers to int_not()
     for(unsigned int i = 0; i < INTS; i++)
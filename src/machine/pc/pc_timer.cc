@@ -6,24 +6,167 @@
 __BEGIN_SYS
 
 Timer * Timer::_channels[CHANNELS];
+bool Timer::_one_shot[Traits<Machine>::CPUS];
+TSC::Time_Stamp Timer::_stamp[Traits<Machine>::CPUS];
+TSC::Time_Stamp Timer::_deadline[Traits<Machine>::CPUS];
+Timer::Handler Timer::_precise;
+bool Timer::_tsc_deadline;
+
+void Timer::one_shot(Tick limit, bool slice)
+{
+    unsigned int cpu = CPU::id();
+
+    Tick ticks = limit;
+    if(slice && _channels[SCHEDULER] && (Tick(_channels[SCHEDULER]->_current[cpu]) < ticks))
+        ticks = _channels[SCHEDULER]->_current[cpu];
+    if((cpu == CPU::BSP) && _channels[USER]) {
+        Count c = _channels[USER]->_current[cpu]; // a channel that is not retriggered keeps counting down (and wraps)
+        if(c && (static_cast<unsigned long>(c) < static_cast<unsigned long>(ticks)))
+            ticks = c;
+    }
+
+    const Tick MAX = Count(-1) / (Engine::clock() / FREQUENCY);
+    if(ticks > MAX)
+        ticks = MAX;
+
+    if(ticks <= 1) {
+        periodic();
+        return;
+    }
+
+    db<Timer>(TRC) << "Timer::one_shot(cpu=" << cpu << ",ticks=" << ticks << ")" << endl;
+
+    // A pending high-resolution deadline comes first
+    if(high_resolution && _deadline[cpu] && (_deadline[cpu] < TSC::time_stamp() + ticks * cycles())) {
+        arm(_deadline[cpu]);
+        return;
+    }
+
+    Engine::config(0, ticks * (Engine::clock() / FREQUENCY), true, false);
+    _one_shot[cpu] = true;
+}
+
+void Timer::periodic()
+{
+    unsigned int cpu = CPU::id();
+
+    if(high_resolution) {
+        const TSC::Time_Stamp TICK = cycles();
+        TSC::Time_Stamp now = TSC::time_stamp();
+        TSC::Time_Stamp boundary = _stamp[cpu] + TICK;
+
+        // Up to the deadline, and then to the end of the tick it fell in, so the ticks keep their phase
+        if(_deadline[cpu] && (_deadline[cpu] < boundary)) {
+            arm(_deadline[cpu]);
+            return;
+        }
+        if(_one_shot[cpu] && (now < boundary) && (now - _stamp[cpu] > TICK / 8)) {
+            arm(boundary);
+            return;
+        }
+    }
+
+    if(_one_shot[cpu]) {
+        Engine::config(0, Engine::clock() / FREQUENCY);
+        _one_shot[cpu] = false;
+    }
+}
+
+void Timer::deadline(TSC::Time_Stamp at)
+{
+    db<Timer>(TRC) << "Timer::deadline(cpu=" << CPU::id() << ",at=" << at << ")" << endl;
+
+    // Once canceled, the one-shot in course just ends the tick as an ordinary interrupt
+    _deadline[CPU::id()] = at;
+    if(at)
+        periodic();
+}
+
+void Timer::arm(TSC::Time_Stamp at)
+{
+    if(_tsc_deadline)
+        APIC::config_timer_deadline(at);
+    else {
+        TSC::Time_Stamp now = TSC::time_stamp();
+        Count count = (at > now) ? Count((at - now) * Engine::clock() / CPU::max_clock()) : 0;
+        Engine::config(0, (count > 16) ? count : 16, true, false); // the APIC divides the count by 16
+    }
+    _one_shot[CPU::id()] = true;
+}
+
+// Ticks since the last interrupt of this core (always at least one, unless it came from a high-resolution deadline)
+Timer::Tick Timer::elapsed()
+{
+    unsigned int cpu = CPU::id();
+    const TSC::Time_Stamp TICK = cycles();
+
+    TSC::Time_Stamp now = TSC::time_stamp();
+    TSC::Time_Stamp delta = now - _stamp[cpu];
+
+    // With deadlines inside the ticks, the TSC grid is never reset and ticks a little early still count
+    if(high_resolution) {
+        Tick n = (delta + TICK / 8) / TICK;
+        _stamp[cpu] += n * TICK;
+        return n;
+    }
+
+    Tick n = delta / TICK;
+    if(n < 1) {
+        _stamp[cpu] = now;
+        return 1;
+    }
+    _stamp[cpu] += n * TICK;
+    return n;
+}
 
 void Timer::int_handler(Interrupt_Id i)
 {
-    if((CPU::id() == CPU::BSP) && _channels[USER] && (--_channels[USER]->_current[CPU::BSP] <= 0)) {
-        if(_channels[USER]->_retrigger)
-            _channels[USER]->_current[CPU::BSP] = _channels[USER]->_initial;
-        _channels[USER]->_handler(i);
+    unsigned int cpu = CPU::id();
+
+    // The deadline is consumed before periodic() reprograms the timer
+    bool precise = false;
+    if(high_resolution && _deadline[cpu] && (TSC::time_stamp() >= _deadline[cpu])) {
+        _deadline[cpu] = 0;
+        precise = true;
     }
 
-    if((CPU::id() == CPU::BSP) && _channels[ALARM] && (--_channels[ALARM]->_current[CPU::BSP] <= 0)) {
-        _channels[ALARM]->_current[CPU::BSP] = _channels[ALARM]->_initial;
-        _channels[ALARM]->_handler(i);
+    Tick n = 1;
+    if(tickless || high_resolution) {
+        n = elapsed();
+        periodic();
     }
 
-    if(_channels[SCHEDULER] && (--_channels[SCHEDULER]->_current[CPU::id()] <= 0)) {
-        _channels[SCHEDULER]->_current[CPU::id()] = _channels[SCHEDULER]->_initial;
-        _channels[SCHEDULER]->_handler(i);
+    // As with one tick per call: the handler runs whenever the count reaches 0 and, if not retriggered, the count
+    // goes on from there (wrapping around), so it runs again after every full turn of the counter
+    if((CPU::id() == CPU::BSP) && _channels[USER]) {
+        Count c = _channels[USER]->_current[CPU::BSP];
+        if(c && (static_cast<unsigned long>(c) <= static_cast<unsigned long>(n))) {
+            _channels[USER]->_current[CPU::BSP] = _channels[USER]->_retrigger ? _channels[USER]->_initial : Count(c - n);
+            _channels[USER]->_handler(i);
+        } else
+            _channels[USER]->_current[CPU::BSP] = c - n;
     }
+
+    // Every core runs its own alarms. Alarm counts one tick per call (Alarm::handler()), so the ticks skipped by one_shot() are replayed
+    if(_channels[ALARM])
+        for(Tick t = 0; t < n; t++) {
+            if(--_channels[ALARM]->_current[CPU::id()] <= 0) {
+                _channels[ALARM]->_current[CPU::id()] = _channels[ALARM]->_initial;
+                _channels[ALARM]->_handler(i);
+            }
+        }
+
+    if(_channels[SCHEDULER]) {
+        if(Tick(_channels[SCHEDULER]->_current[CPU::id()]) > n)
+            _channels[SCHEDULER]->_current[CPU::id()] -= n;
+        else {
+            _channels[SCHEDULER]->_current[CPU::id()] = _channels[SCHEDULER]->_initial;
+            _channels[SCHEDULER]->_handler(i);
+        }
+    }
+
+    if(precise && _precise)
+        _precise(i);
 }
 
 __END_SYS
@@ -11,8 +11,10 @@ void Timer::init()
 
     CPU::int_disable();
 
-    if(CPU::id() == CPU::BSP)
+    if(CPU::id() == CPU::BSP) {
         IC::int_vector(IC::INT_SYS_TIMER, int_handler);
+        _tsc_deadline = high_resolution && CPU::has_tsc_deadline();
+    }
 
     disable();
     reset();
@@ -0,0 +1,163 @@
+// EPOS Alarm Timing Wheel Test Program
+
+#include <time.h>
+
+using namespace EPOS;
+
+const unsigned int same_tick_alarms = 16;
+const Milisecond same_tick_period = 50;
+
+// Around the boundaries of the first wheel levels (32, 1024 and 32768 ticks at 1 kHz), so these alarms cascade down
+const unsigned int spans = 9;
+const Milisecond span[spans] = { 31, 32, 33, 1023, 1024, 1025, 32767, 32768, 32769 };
+
+// Further than the wheel's HORIZON (2^25 - 1 ticks, about 9.3 hours at 1 kHz), so it wraps around the last level
+const Second beyond_horizon = 10 * 60 * 60;
+
+struct Probe
+{
+    unsigned int id;
+    unsigned int count;
+    Microsecond fired;
+};
+
+OStream cout;
+TSC_Chronometer chrono;
+Alarm_Chronometer ticks;
+
+unsigned int released;
+unsigned int order[same_tick_alarms];
+Alarm * victim;
+unsigned int victim_count;
+
+void same_tick(Probe * p)
+{
+    p->count++;
+    p->fired = chrono.read();
+    order[released++] = p->id;
+}
+
+void cascade(Probe * p)
+{
+    p->count++;
+    p->fired = chrono.read();
+}
+
+void never(Probe * p)
+{
+    p->count++;
+}
+
+// Runs first in a tick whose alarms are all in _due already, and cancels the next one before its handler is called
+void kill()
+{
+    delete victim;
+    victim = 0;
+}
+
+void die()
+{
+    victim_count++;
+}
+
+// Busy waits for the next tick, so the alarms created right after it all fall in the same tick
+void align()
+{
+    Microsecond t = ticks.read();
+    while(ticks.read() == t);
+}
+
+void check(const char * what, bool ok)
+{
+    cout << what << (ok ? ": passed" : ": FAILED") << endl;
+}
+
+int main()
+{
+    cout << "Alarm Timing Wheel Test" << endl;
+
+    ticks.start();
+    chrono.start();
+
+    Probe far_probe = { 0, 0, 0 };
+    Functor_Handler<Probe> far_handler(&never, &far_probe);
+    Alarm * far_alarm = new Alarm(beyond_horizon, &far_handler);
+
+    cout << "\nCreating " << same_tick_alarms << " alarms in the same tick, due " << same_tick_period << " ms later ..." << endl;
+
+    Probe same[same_tick_alarms];
+    Functor_Handler<Probe> * same_handler[same_tick_alarms];
+    for(unsigned int i = 0; i < same_tick_alarms; i++) {
+        same[i].id = i;
+        same[i].count = 0;
+        same_handler[i] = new Functor_Handler<Probe>(&same_tick, &same[i]);
+    }
+
+    Alarm * same_alarm[same_tick_alarms];
+    align();
+    for(unsigned int i = 0; i < same_tick_alarms; i++)
+        same_alarm[i] = new Alarm(Microsecond(same_tick_period), same_handler[i]);
+
+    Alarm::delay(Microsecond(same_tick_period) * 2);
+
+    const Microsecond tick = 1000000 / Alarm::frequency();
+
+    bool ok = (released == same_tick_alarms);
+    for(unsigned int i = 0; i < same_tick_alarms; i++)
+        ok = ok && (same[i].count == 1) && (same[i].fired - same[0].fired < tick) && (order[i] == i);
+    check("All released once, in the same tick and in creation order", ok);
+
+    for(unsigned int i = 0; i < same_tick_alarms; i++) {
+        delete same_alarm[i];
+        delete same_handler[i];
+    }
+
+    cout << "\nCreating one alarm in the same tick as the one that cancels it, before its handler runs ..." << endl;
+
+    Function_Handler killer_handler(&kill);
+    Function_Handler victim_handler(&die);
+    align();
+    Alarm * killer = new Alarm(Microsecond(same_tick_period), &killer_handler);
+    victim = new Alarm(Microsecond(same_tick_period), &victim_handler);
+
+    Alarm::delay(Microsecond(same_tick_period) * 2);
+
+    check("Cancelled while due", (victim == 0) && (victim_count == 0));
+    delete killer;
+
+    cout << "\nCreating alarms around the wheel level boundaries (";
+    for(unsigned int i = 0; i < spans; i++)
+        cout << span[i] << (i < spans - 1 ? ", " : " ms) ...");
+    cout << endl;
+
+    Probe probe[spans];
+    Functor_Handler<Probe> * handler[spans];
+    Alarm * alarm[spans];
+    Microsecond created[spans];
+    for(unsigned int i = 0; i < spans; i++) {
+        probe[i].id = i;
+        probe[i].count = 0;
+        handler[i] = new Functor_Handler<Probe>(&cascade, &probe[i]);
+        created[i] = chrono.read();
+        alarm[i] = new Alarm(Microsecond(span[i]), handler[i]);
+    }
+
+    Alarm::delay(Microsecond(span[spans - 1]) + Microsecond(Milisecond(100)));
+
+    for(unsigned int i = 0; i < spans; i++) {
+        Microsecond expected = created[i] + Microsecond(span[i]);
+        bool on_time = (probe[i].fired + tick >= expected) && (probe[i].fired <= expected + 2 * tick);
+        cout << span[i] << " ms: fired " << probe[i].count << " time(s) after " << (probe[i].fired - created[i]) << " us" << endl;
+        check("Cascaded on time", (probe[i].count == 1) && on_time);
+        delete alarm[i];
+        delete handler[i];
+    }
+
+    cout << "\nThe alarm set " << beyond_horizon << " s ahead, beyond the wheel's horizon, must still be pending ..." << endl;
+    check("Not released early", far_probe.count == 0);
+    delete far_alarm;
+
+    cout << "\nI'm done, bye!" << endl;
+
+    return 0;
+}
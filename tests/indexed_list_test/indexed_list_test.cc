@@ -0,0 +1,138 @@
+// EPOS Indexed Ordered List Utility Test Program
+
+#include <utility/ostream.h>
+#include <utility/list.h>
+
+using namespace EPOS;
+
+const unsigned int N = 64;
+
+typedef Indexed_Ordered_List<unsigned int> Queue;
+typedef Queue::Element Element;
+
+OStream cout;
+
+unsigned int id[N];
+Element * element[N];
+
+// Reference order: ranks ascending and, among equal ranks, the order of insertion (or of the last rerank())
+unsigned int expected[N];
+unsigned int expected_size;
+
+void expect_insert(unsigned int i)
+{
+    unsigned int p = expected_size;
+    while((p > 0) && (element[expected[p - 1]]->rank() > element[i]->rank())) {
+        expected[p] = expected[p - 1];
+        p--;
+    }
+    expected[p] = i;
+    expected_size++;
+}
+
+void expect_remove(unsigned int i)
+{
+    unsigned int p = 0;
+    while(expected[p] != i)
+        p++;
+    for(expected_size--; p < expected_size; p++)
+        expected[p] = expected[p + 1];
+}
+
+void insert(Queue & l, unsigned int i, int rank)
+{
+    element[i]->rank(rank);
+    l.insert(element[i]);
+    expect_insert(i);
+}
+
+void remove(Queue & l, unsigned int i)
+{
+    l.remove(element[i]);
+    expect_remove(i);
+}
+
+void rerank(Queue & l, unsigned int i, int rank)
+{
+    expect_remove(i);
+    element[i]->rank(rank);
+    l.rerank(element[i]);
+    expect_insert(i);
+}
+
+void check(const char * what, Queue & l)
+{
+    bool ok = (l.size() == expected_size);
+    unsigned int p = 0;
+    for(Queue::Iterator it = l.begin(); ok && (it != l.end()); ++it, p++)
+        ok = (p < expected_size) && (it->object() == &id[expected[p]]);
+    ok = ok && (p == expected_size);
+
+    cout << what << (ok ? ": passed" : ": FAILED") << endl;
+    if(!ok) {
+        cout << "list:    ";
+        for(Queue::Iterator it = l.begin(); it != l.end(); ++it)
+            cout << *it->object() << "(" << it->rank() << ") ";
+        cout << "\nexpected:";
+        for(p = 0; p < expected_size; p++)
+            cout << " " << expected[p] << "(" << element[expected[p]]->rank() << ")";
+        cout << endl;
+    }
+}
+
+int main()
+{
+    cout << "Indexed Ordered List Test" << endl;
+
+    for(unsigned int i = 0; i < N; i++) {
+        id[i] = i;
+        element[i] = new Element(&id[i]);
+    }
+
+    Queue l;
+
+    cout << "\nInserting " << N << " elements with the same rank ..." << endl;
+    for(unsigned int i = 0; i < N; i++)
+        insert(l, i, 5);
+    check("FIFO among equal ranks", l);
+
+    cout << "\nRemoving every third element and inserting them back with the same rank ..." << endl;
+    for(unsigned int i = 0; i < N; i += 3)
+        remove(l, i);
+    check("Order kept after removals", l);
+    for(unsigned int i = 0; i < N; i += 3)
+        insert(l, i, 5);
+    check("Reinserted ones after the others", l);
+
+    cout << "\nEmptying the list from the head ..." << endl;
+    for(unsigned int p = 0; p < N; p++) {
+        Element * e = l.remove();
+        expect_remove(*e->object());
+    }
+    check("Empty", l);
+
+    cout << "\nInserting " << N << " elements with only four distinct ranks ..." << endl;
+    for(unsigned int i = 0; i < N; i++)
+        insert(l, i, (i * 7) % 4);
+    check("Sorted by rank, FIFO among equal ranks", l);
+
+    cout << "\nReranking some elements to a rank already in the list ..." << endl;
+    for(unsigned int i = 1; i < N; i += 5)
+        rerank(l, i, 2);
+    check("Reranked ones after the others of their new rank", l);
+
+    cout << "\nRemoving from both ends and from the middle ..." << endl;
+    remove(l, *l.head()->object());
+    remove(l, *l.tail()->object());
+    remove(l, expected[expected_size / 2]);
+    check("Order kept", l);
+
+    while(!l.empty())
+        l.remove();
+    for(unsigned int i = 0; i < N; i++)
+        delete element[i];
+
+    cout << "\nI'm done, bye!" << endl;
+
+    return 0;
+}